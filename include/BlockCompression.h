@@ -0,0 +1,380 @@
+#ifndef BLOCK_COMPRESSION_H
+#define BLOCK_COMPRESSION_H
+
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <stdint.h>
+
+#include <ThreadPool.h>
+
+// CPU上的BCn编码器, 每个4x4像素块独立编码:
+// BC1: RGB, 8字节/块(压缩比6:1); BC3: BC1颜色 + BC4格式的alpha, 16字节/块
+// BC4: 单通道, 8字节/块; BC5: 两个BC4通道, 16字节/块, 用来存法线的XY
+// 块按行分给线程池编码, 编码时顺便解码回来统计误差, 得到整张图的PSNR
+enum BlockFormat
+{
+  BLOCK_BC1,
+  BLOCK_BC3,
+  BLOCK_BC4,
+  BLOCK_BC5
+};
+
+inline unsigned int blockBytes(BlockFormat format)
+{
+  return (format == BLOCK_BC1 || format == BLOCK_BC4) ? 8 : 16;
+}
+
+// width x height的图片压缩后的字节数, 不足4的边按一个块算
+inline size_t compressedSize(BlockFormat format, unsigned int width, unsigned int height)
+{
+  return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+// 压缩一张n通道的图片, 返回PSNR(dB, 完全无损时返回999)
+// BC1用前3个通道, BC3用4个通道, BC4用第0个通道, BC5用第0和第1个通道
+double compressImage(BlockFormat format, const unsigned char *pixels, unsigned int width, unsigned int height, unsigned int channels, unsigned char *out);
+
+inline uint16_t packColor565(const float *c)
+{
+  int r = (int)(c[0] * (31.0f / 255.0f) + 0.5f);
+  int g = (int)(c[1] * (63.0f / 255.0f) + 0.5f);
+  int b = (int)(c[2] * (31.0f / 255.0f) + 0.5f);
+  r = r < 0 ? 0 : (r > 31 ? 31 : r);
+  g = g < 0 ? 0 : (g > 63 ? 63 : g);
+  b = b < 0 ? 0 : (b > 31 ? 31 : b);
+  return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+inline void unpackColor565(uint16_t c, int *rgb)
+{
+  int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+  rgb[0] = (r << 3) | (r >> 2);
+  rgb[1] = (g << 2) | (g >> 4);
+  rgb[2] = (b << 3) | (b >> 2);
+}
+
+// 4色模式的调色板: c0, c1, 2/3*c0 + 1/3*c1, 1/3*c0 + 2/3*c1
+inline void colorPalette(uint16_t c0, uint16_t c1, int palette[4][3])
+{
+  unpackColor565(c0, palette[0]);
+  unpackColor565(c1, palette[1]);
+  for (int c = 0; c < 3; c++)
+  {
+    palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+    palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+  }
+}
+
+// 给每个像素选最近的调色板颜色, 返回索引和总误差
+inline int fitColorIndices(const float colors[16][3], uint16_t c0, uint16_t c1, uint32_t &indices)
+{
+  int palette[4][3];
+  colorPalette(c0, c1, palette);
+  indices = 0;
+  int total = 0;
+  for (int i = 0; i < 16; i++)
+  {
+    int best = 0, bestError = 0x7fffffff;
+    for (int p = 0; p < 4; p++)
+    {
+      int dr = (int)colors[i][0] - palette[p][0];
+      int dg = (int)colors[i][1] - palette[p][1];
+      int db = (int)colors[i][2] - palette[p][2];
+      int error = dr * dr + dg * dg + db * db;
+      if (error < bestError)
+      {
+        bestError = error;
+        best = p;
+      }
+    }
+    indices |= (uint32_t)best << (2 * i);
+    total += bestError;
+  }
+  return total;
+}
+
+// 已知索引时用最小二乘求最优的两个端点
+inline bool refineEndpoints(const float colors[16][3], uint32_t indices, float *e0, float *e1)
+{
+  static const float weight0[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+  float aa = 0, ab = 0, bb = 0, ax[3] = { 0, 0, 0 }, bx[3] = { 0, 0, 0 };
+  for (int i = 0; i < 16; i++)
+  {
+    float a = weight0[(indices >> (2 * i)) & 3], b = 1.0f - a;
+    aa += a * a;
+    ab += a * b;
+    bb += b * b;
+    for (int c = 0; c < 3; c++)
+    {
+      ax[c] += a * colors[i][c];
+      bx[c] += b * colors[i][c];
+    }
+  }
+  float det = aa * bb - ab * ab;
+  if (fabsf(det) < 1e-6f)
+    return false;
+  for (int c = 0; c < 3; c++)
+  {
+    e0[c] = (ax[c] * bb - bx[c] * ab) / det;
+    e1[c] = (bx[c] * aa - ax[c] * ab) / det;
+  }
+  return true;
+}
+
+inline void writeColorBlock(uint16_t c0, uint16_t c1, uint32_t indices, unsigned char *out)
+{
+  out[0] = (unsigned char)(c0 & 0xff);
+  out[1] = (unsigned char)(c0 >> 8);
+  out[2] = (unsigned char)(c1 & 0xff);
+  out[3] = (unsigned char)(c1 >> 8);
+  for (int i = 0; i < 4; i++)
+    out[4 + i] = (unsigned char)(indices >> (8 * i));
+}
+
+// 沿颜色的主轴取两端作为端点, 再用最小二乘修正一次, 保留误差更小的结果
+inline void encodeColorBlock(const unsigned char *rgba, unsigned char *out)
+{
+  float colors[16][3];
+  float mean[3] = { 0, 0, 0 };
+  for (int i = 0; i < 16; i++)
+    for (int c = 0; c < 3; c++)
+    {
+      colors[i][c] = rgba[i * 4 + c];
+      mean[c] += colors[i][c];
+    }
+  for (int c = 0; c < 3; c++)
+    mean[c] /= 16.0f;
+
+  float cov[6] = { 0, 0, 0, 0, 0, 0 };
+  for (int i = 0; i < 16; i++)
+  {
+    float r = colors[i][0] - mean[0], g = colors[i][1] - mean[1], b = colors[i][2] - mean[2];
+    cov[0] += r * r;
+    cov[1] += r * g;
+    cov[2] += r * b;
+    cov[3] += g * g;
+    cov[4] += g * b;
+    cov[5] += b * b;
+  }
+  // 幂迭代求协方差矩阵的主特征向量
+  float axis[3] = { 0.2126f, 0.7152f, 0.0722f };
+  for (int iter = 0; iter < 8; iter++)
+  {
+    float x = axis[0] * cov[0] + axis[1] * cov[1] + axis[2] * cov[2];
+    float y = axis[0] * cov[1] + axis[1] * cov[3] + axis[2] * cov[4];
+    float z = axis[0] * cov[2] + axis[1] * cov[4] + axis[2] * cov[5];
+    float length = sqrtf(x * x + y * y + z * z);
+    if (length < 1e-6f)
+      break;
+    axis[0] = x / length;
+    axis[1] = y / length;
+    axis[2] = z / length;
+  }
+
+  float minDot = 1e30f, maxDot = -1e30f;
+  int minIndex = 0, maxIndex = 0;
+  for (int i = 0; i < 16; i++)
+  {
+    float d = colors[i][0] * axis[0] + colors[i][1] * axis[1] + colors[i][2] * axis[2];
+    if (d < minDot) { minDot = d; minIndex = i; }
+    if (d > maxDot) { maxDot = d; maxIndex = i; }
+  }
+  uint16_t c0 = packColor565(colors[maxIndex]);
+  uint16_t c1 = packColor565(colors[minIndex]);
+  if (c0 == c1)
+  {
+    // 整块是同一个颜色(量化后), 索引全部指向c0
+    writeColorBlock(c0, c1, 0, out);
+    return;
+  }
+  // c0 > c1才是4色模式, 否则会被解码成带透明色的3色模式
+  if (c0 < c1)
+  {
+    uint16_t t = c0;
+    c0 = c1;
+    c1 = t;
+  }
+  uint32_t indices;
+  int error = fitColorIndices(colors, c0, c1, indices);
+
+  float e0[3], e1[3];
+  if (refineEndpoints(colors, indices, e0, e1))
+  {
+    uint16_t r0 = packColor565(e0), r1 = packColor565(e1);
+    if (r0 != r1)
+    {
+      if (r0 < r1)
+      {
+        uint16_t t = r0;
+        r0 = r1;
+        r1 = t;
+      }
+      uint32_t refined;
+      int refinedError = fitColorIndices(colors, r0, r1, refined);
+      if (refinedError < error)
+      {
+        c0 = r0;
+        c1 = r1;
+        indices = refined;
+      }
+    }
+  }
+  writeColorBlock(c0, c1, indices, out);
+}
+
+inline void decodeColorBlock(const unsigned char *block, unsigned char *rgba)
+{
+  uint16_t c0 = (uint16_t)(block[0] | (block[1] << 8));
+  uint16_t c1 = (uint16_t)(block[2] | (block[3] << 8));
+  uint32_t indices = (uint32_t)block[4] | ((uint32_t)block[5] << 8) | ((uint32_t)block[6] << 16) | ((uint32_t)block[7] << 24);
+  int palette[4][3];
+  colorPalette(c0, c1, palette);
+  for (int i = 0; i < 16; i++)
+  {
+    const int *p = palette[(indices >> (2 * i)) & 3];
+    rgba[i * 4 + 0] = (unsigned char)p[0];
+    rgba[i * 4 + 1] = (unsigned char)p[1];
+    rgba[i * 4 + 2] = (unsigned char)p[2];
+  }
+}
+
+// 8值模式(e0 > e1)的调色板: e0, e1, 以及两者之间的6个插值
+inline void valuePalette(int e0, int e1, int palette[8])
+{
+  palette[0] = e0;
+  palette[1] = e1;
+  if (e0 > e1)
+    for (int i = 2; i < 8; i++)
+      palette[i] = ((8 - i) * e0 + (i - 1) * e1) / 7;
+  else
+  {
+    for (int i = 2; i < 6; i++)
+      palette[i] = ((6 - i) * e0 + (i - 1) * e1) / 5;
+    palette[6] = 0;
+    palette[7] = 255;
+  }
+}
+
+// BC4: 取块内的最大最小值作为端点, stride是相邻像素之间的字节数
+inline void encodeValueBlock(const unsigned char *values, int stride, unsigned char *out)
+{
+  int lo = 255, hi = 0;
+  for (int i = 0; i < 16; i++)
+  {
+    int v = values[i * stride];
+    lo = v < lo ? v : lo;
+    hi = v > hi ? v : hi;
+  }
+  out[0] = (unsigned char)hi;
+  out[1] = (unsigned char)lo;
+  uint64_t bits = 0;
+  if (hi > lo)
+  {
+    int palette[8];
+    valuePalette(hi, lo, palette);
+    for (int i = 0; i < 16; i++)
+    {
+      int v = values[i * stride];
+      int best = 0, bestError = 256;
+      for (int p = 0; p < 8; p++)
+      {
+        int error = abs(v - palette[p]);
+        if (error < bestError)
+        {
+          bestError = error;
+          best = p;
+        }
+      }
+      bits |= (uint64_t)best << (3 * i);
+    }
+  }
+  for (int i = 0; i < 6; i++)
+    out[2 + i] = (unsigned char)(bits >> (8 * i));
+}
+
+inline void decodeValueBlock(const unsigned char *block, unsigned char *values, int stride)
+{
+  int palette[8];
+  valuePalette(block[0], block[1], palette);
+  uint64_t bits = 0;
+  for (int i = 0; i < 6; i++)
+    bits |= (uint64_t)block[2 + i] << (8 * i);
+  for (int i = 0; i < 16; i++)
+    values[i * stride] = (unsigned char)palette[(bits >> (3 * i)) & 7];
+}
+
+double compressImage(BlockFormat format, const unsigned char *pixels, unsigned int width, unsigned int height, unsigned int channels, unsigned char *out)
+{
+  unsigned int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+  unsigned int size = blockBytes(format);
+  std::vector<double> rowErrors(blocksY, 0.0);
+
+  ThreadPool::shared().parallelFor(blocksY, [&](unsigned int by)
+  {
+    unsigned char block[64], decoded[64];
+    double rowError = 0.0;
+    for (unsigned int bx = 0; bx < blocksX; bx++)
+    {
+      // 取出4x4块, 统一成RGBA; 超出边界的像素重复边缘
+      for (unsigned int y = 0; y < 4; y++)
+        for (unsigned int x = 0; x < 4; x++)
+        {
+          unsigned int px = bx * 4 + x < width ? bx * 4 + x : width - 1;
+          unsigned int py = by * 4 + y < height ? by * 4 + y : height - 1;
+          const unsigned char *src = pixels + ((size_t)py * width + px) * channels;
+          unsigned char *dst = block + (y * 4 + x) * 4;
+          for (unsigned int c = 0; c < 4; c++)
+            dst[c] = c < channels ? src[c] : (c == 3 ? 255 : src[0]);
+        }
+
+      unsigned char *dst = out + ((size_t)by * blocksX + bx) * size;
+      unsigned int compared = 0;
+      memcpy(decoded, block, sizeof(block));
+      switch (format)
+      {
+      case BLOCK_BC1:
+        encodeColorBlock(block, dst);
+        decodeColorBlock(dst, decoded);
+        compared = 3;
+        break;
+      case BLOCK_BC3:
+        encodeValueBlock(block + 3, 4, dst);
+        encodeColorBlock(block, dst + 8);
+        decodeValueBlock(dst, decoded + 3, 4);
+        decodeColorBlock(dst + 8, decoded);
+        compared = 4;
+        break;
+      case BLOCK_BC4:
+        encodeValueBlock(block, 4, dst);
+        decodeValueBlock(dst, decoded, 4);
+        compared = 1;
+        break;
+      case BLOCK_BC5:
+        encodeValueBlock(block, 4, dst);
+        encodeValueBlock(block + 1, 4, dst + 8);
+        decodeValueBlock(dst, decoded, 4);
+        decodeValueBlock(dst + 8, decoded + 1, 4);
+        compared = 2;
+        break;
+      }
+      for (unsigned int i = 0; i < 16; i++)
+        for (unsigned int c = 0; c < compared; c++)
+        {
+          double d = (double)block[i * 4 + c] - decoded[i * 4 + c];
+          rowError += d * d;
+        }
+    }
+    rowErrors[by] = rowError;
+  });
+
+  double total = 0.0;
+  for (unsigned int i = 0; i < blocksY; i++)
+    total += rowErrors[i];
+  unsigned int compared = format == BLOCK_BC1 ? 3 : (format == BLOCK_BC3 ? 4 : (format == BLOCK_BC4 ? 1 : 2));
+  double mse = total / ((double)blocksX * blocksY * 16 * compared);
+  return mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / mse) : 999.0;
+}
+
+#endif
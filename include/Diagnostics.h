@@ -0,0 +1,16 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+// 加载阶段每个模型、网格、程序、贴图各一行的统计(MODEL::IMPORT、MESH::OPTIMIZE、MESH::LOD、SHADER::PROGRAM、TEXTURE::COOK)
+// 默认关闭, 启动时只打印错误、警告和汇总(ARENA::、SHADER::STAGES::); 分析加载耗时时打开
+struct Diagnostics
+{
+  static bool verboseLoading;
+  // 网格簇剔除的统计(MESHLETS::), 相机移动时每帧都在变; 默认关闭, 调剔除参数时打开
+  static bool verboseCulling;
+};
+
+bool Diagnostics::verboseLoading = false;
+bool Diagnostics::verboseCulling = false;
+
+#endif
@@ -0,0 +1,264 @@
+#ifndef GL_DIRECT_STATE_H
+#define GL_DIRECT_STATE_H
+
+#include <glad/glad.h>
+
+#include <GLExtensions.h>
+#include <GLState.h>
+
+// 创建和修改GL对象的薄封装: 有GL 4.5/ARB_direct_state_access时按名字直接操作, 不碰任何绑定点;
+// 没有时退回原来的先绑定再修改, 缓冲区用COPY_WRITE/COPY_READ绑定点, 不影响当前VAO记录的缓冲区
+// 注意直接访问只能用于glCreate*创建的对象, glGen*只分配名字, 第一次绑定之前对象并不存在, 所以创建也要经过这里
+
+inline unsigned int createBufferObject()
+{
+  unsigned int id;
+  if (glCapabilities().directStateAccess)
+    glCreateBuffers(1, &id);
+  else
+    glGenBuffers(1, &id);
+  return id;
+}
+
+inline unsigned int createVertexArrayObject()
+{
+  unsigned int id;
+  if (glCapabilities().directStateAccess)
+    glCreateVertexArrays(1, &id);
+  else
+    glGenVertexArrays(1, &id);
+  return id;
+}
+
+inline unsigned int createTextureObject(GLenum target)
+{
+  unsigned int id;
+  if (glCapabilities().directStateAccess)
+    glCreateTextures(target, 1, &id);
+  else
+    glGenTextures(1, &id);
+  return id;
+}
+
+inline unsigned int createFramebufferObject()
+{
+  unsigned int id;
+  if (glCapabilities().directStateAccess)
+    glCreateFramebuffers(1, &id);
+  else
+    glGenFramebuffers(1, &id);
+  return id;
+}
+
+inline unsigned int createRenderbufferObject()
+{
+  unsigned int id;
+  if (glCapabilities().directStateAccess)
+    glCreateRenderbuffers(1, &id);
+  else
+    glGenRenderbuffers(1, &id);
+  return id;
+}
+
+// 缓冲区
+
+inline void namedBufferStorage(unsigned int buffer, size_t size, const void *data, GLbitfield flags)
+{
+  if (glCapabilities().directStateAccess)
+  {
+    glNamedBufferStorage(buffer, size, data, flags);
+    return;
+  }
+  glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+  glBufferStorage(GL_COPY_WRITE_BUFFER, size, data, flags);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+inline void namedBufferData(unsigned int buffer, size_t size, const void *data, GLenum usage)
+{
+  if (glCapabilities().directStateAccess)
+  {
+    glNamedBufferData(buffer, size, data, usage);
+    return;
+  }
+  glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+  glBufferData(GL_COPY_WRITE_BUFFER, size, data, usage);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+inline void namedBufferSubData(unsigned int buffer, size_t offset, size_t size, const void *data)
+{
+  if (glCapabilities().directStateAccess)
+  {
+    glNamedBufferSubData(buffer, offset, size, data);
+    return;
+  }
+  glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+  glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+inline void copyNamedBufferSubData(unsigned int source, unsigned int destination, size_t sourceOffset, size_t destinationOffset, size_t size)
+{
+  if (glCapabilities().directStateAccess)
+  {
+    glCopyNamedBufferSubData(source, destination, sourceOffset, destinationOffset, size);
+    return;
+  }
+  glBindBuffer(GL_COPY_READ_BUFFER, source);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, destination);
+  glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, sourceOffset, destinationOffset, size);
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+inline void *mapNamedBufferRange(unsigned int buffer, size_t offset, size_t length, GLbitfield access)
+{
+  if (glCapabilities().directStateAccess)
+    return glMapNamedBufferRange(buffer, offset, length, access);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+  void *data = glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, length, access);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  return data;
+}
+
+inline void unmapNamedBuffer(unsigned int buffer)
+{
+  if (glCapabilities().directStateAccess)
+  {
+    glUnmapNamedBuffer(buffer);
+    return;
+  }
+  glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+  glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+// 纹理
+
+// 不可变存储要求带位数的格式, 烘焙的贴图和stb解码的数据用的是不带位数的基本格式
+inline GLenum sizedInternalFormat(GLenum internalFormat)
+{
+  switch (internalFormat)
+  {
+  case GL_RED: return GL_R8;
+  case GL_RG: return GL_RG8;
+  case GL_RGB: return GL_RGB8;
+  case GL_RGBA: return GL_RGBA8;
+  case GL_SRGB: return GL_SRGB8;
+  case GL_SRGB_ALPHA: return GL_SRGB8_ALPHA8;
+  default: return internalFormat;
+  }
+}
+
+// 完整mip链的级数
+inline GLsizei mipLevelCount(GLsizei width, GLsizei height)
+{
+  GLsizei size = width > height ? width : height;
+  GLsizei levels = 1;
+  while (size > 1)
+  {
+    size >>= 1;
+    levels++;
+  }
+  return levels;
+}
+
+// 分配levels级的存储, target是GL_TEXTURE_2D或GL_TEXTURE_CUBE_MAP
+// 直接访问时是不可变存储, 每个纹理只能分配一次, 之后用glTextureSubImage*写入; 否则逐级(逐面)调用glTexImage2D, format和type只在这时使用
+// 可变的存储(比如异步加载的占位图)还可以再分配一次不可变存储, 反过来不行
+inline void textureStorage(unsigned int texture, GLenum target, GLsizei levels, GLenum internalFormat, GLsizei width, GLsizei height, GLenum format, GLenum type)
+{
+  if (glCapabilities().directStateAccess)
+  {
+    glTextureStorage2D(texture, levels, sizedInternalFormat(internalFormat), width, height);
+    return;
+  }
+  GLState::instance().bindTexture(target, texture);
+  unsigned int faces = target == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+  for (GLsizei level = 0; level < levels; level++)
+  {
+    GLsizei levelWidth = width >> level > 0 ? width >> level : 1;
+    GLsizei levelHeight = height >> level > 0 ? height >> level : 1;
+    for (unsigned int face = 0; face < faces; face++)
+    {
+      GLenum imageTarget = target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : target;
+      glTexImage2D(imageTarget, level, internalFormat, levelWidth, levelHeight, 0, format, type, nullptr);
+    }
+  }
+}
+
+inline void textureParameter(unsigned int texture, GLenum target, GLenum name, GLint value)
+{
+  if (glCapabilities().directStateAccess)
+  {
+    glTextureParameteri(texture, name, value);
+    return;
+  }
+  // 连续设置同一个纹理的参数时, 重复的绑定被状态缓存过滤掉
+  GLState::instance().bindTexture(target, texture);
+  glTexParameteri(target, name, value);
+}
+
+inline void textureParameter(unsigned int texture, GLenum target, GLenum name, const GLint *values)
+{
+  if (glCapabilities().directStateAccess)
+  {
+    glTextureParameteriv(texture, name, values);
+    return;
+  }
+  GLState::instance().bindTexture(target, texture);
+  glTexParameteriv(target, name, values);
+}
+
+inline void generateMipmap(unsigned int texture, GLenum target)
+{
+  if (glCapabilities().directStateAccess)
+  {
+    glGenerateTextureMipmap(texture);
+    return;
+  }
+  GLState::instance().bindTexture(target, texture);
+  glGenerateMipmap(target);
+}
+
+// 帧缓冲
+
+inline void renderbufferStorage(unsigned int renderbuffer, GLenum internalFormat, GLsizei width, GLsizei height)
+{
+  if (glCapabilities().directStateAccess)
+  {
+    glNamedRenderbufferStorage(renderbuffer, internalFormat, width, height);
+    return;
+  }
+  glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+  glRenderbufferStorage(GL_RENDERBUFFER, internalFormat, width, height);
+}
+
+inline void framebufferRenderbuffer(unsigned int framebuffer, GLenum attachment, unsigned int renderbuffer)
+{
+  if (glCapabilities().directStateAccess)
+  {
+    glNamedFramebufferRenderbuffer(framebuffer, attachment, GL_RENDERBUFFER, renderbuffer);
+    return;
+  }
+  GLState::instance().bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, attachment, GL_RENDERBUFFER, renderbuffer);
+}
+
+// imageTarget是GL_TEXTURE_2D或者立方体贴图的某个面
+inline void framebufferTexture2D(unsigned int framebuffer, GLenum attachment, GLenum imageTarget, unsigned int texture, GLint level)
+{
+  if (glCapabilities().directStateAccess)
+  {
+    if (imageTarget >= GL_TEXTURE_CUBE_MAP_POSITIVE_X && imageTarget <= GL_TEXTURE_CUBE_MAP_NEGATIVE_Z)
+      glNamedFramebufferTextureLayer(framebuffer, attachment, texture, level, imageTarget - GL_TEXTURE_CUBE_MAP_POSITIVE_X);
+    else
+      glNamedFramebufferTexture(framebuffer, attachment, texture, level);
+    return;
+  }
+  GLState::instance().bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, imageTarget, texture, level);
+}
+
+#endif
@@ -0,0 +1,282 @@
+#ifndef GL_EXTENSIONS_H
+#define GL_EXTENSIONS_H
+
+#include <glad/glad.h>
+#include <cstring>
+
+// glad只生成了3.3核心模式的函数, 更高版本或扩展里的函数在这里手动加载
+// 在gladLoadGLLoader之后调用loadGLExtensions, 然后通过glCapabilities()判断能不能用
+
+// GL 4.4 / ARB_buffer_storage
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+#ifndef GL_DYNAMIC_STORAGE_BIT
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#endif
+#ifndef GL_CLIENT_STORAGE_BIT
+#define GL_CLIENT_STORAGE_BIT 0x0200
+#endif
+typedef void (APIENTRYP PFNGLEXTBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+
+PFNGLEXTBUFFERSTORAGEPROC glext_glBufferStorage = nullptr;
+#define glBufferStorage glext_glBufferStorage
+
+// GL 4.1 / ARB_get_program_binary
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+typedef void (APIENTRYP PFNGLEXTGETPROGRAMBINARYPROC)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+typedef void (APIENTRYP PFNGLEXTPROGRAMBINARYPROC)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+typedef void (APIENTRYP PFNGLEXTPROGRAMPARAMETERIPROC)(GLuint program, GLenum pname, GLint value);
+
+PFNGLEXTGETPROGRAMBINARYPROC glext_glGetProgramBinary = nullptr;
+PFNGLEXTPROGRAMBINARYPROC glext_glProgramBinary = nullptr;
+PFNGLEXTPROGRAMPARAMETERIPROC glext_glProgramParameteri = nullptr;
+#define glGetProgramBinary glext_glGetProgramBinary
+#define glProgramBinary glext_glProgramBinary
+#define glProgramParameteri glext_glProgramParameteri
+
+// KHR_parallel_shader_compile / ARB_parallel_shader_compile, 两个扩展的枚举值相同
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+typedef void (APIENTRYP PFNGLEXTMAXSHADERCOMPILERTHREADSPROC)(GLuint count);
+
+PFNGLEXTMAXSHADERCOMPILERTHREADSPROC glext_glMaxShaderCompilerThreadsKHR = nullptr;
+#define glMaxShaderCompilerThreadsKHR glext_glMaxShaderCompilerThreadsKHR
+
+// GL 4.5 / ARB_direct_state_access: 直接按名字创建和修改对象, 不经过绑定点
+// 只加载了创建资源用到的函数, 见GLDirectState.h
+typedef void (APIENTRYP PFNGLEXTCREATEBUFFERSPROC)(GLsizei n, GLuint *buffers);
+typedef void (APIENTRYP PFNGLEXTNAMEDBUFFERSTORAGEPROC)(GLuint buffer, GLsizeiptr size, const void *data, GLbitfield flags);
+typedef void (APIENTRYP PFNGLEXTNAMEDBUFFERDATAPROC)(GLuint buffer, GLsizeiptr size, const void *data, GLenum usage);
+typedef void (APIENTRYP PFNGLEXTNAMEDBUFFERSUBDATAPROC)(GLuint buffer, GLintptr offset, GLsizeiptr size, const void *data);
+typedef void (APIENTRYP PFNGLEXTCOPYNAMEDBUFFERSUBDATAPROC)(GLuint readBuffer, GLuint writeBuffer, GLintptr readOffset, GLintptr writeOffset, GLsizeiptr size);
+typedef void *(APIENTRYP PFNGLEXTMAPNAMEDBUFFERRANGEPROC)(GLuint buffer, GLintptr offset, GLsizeiptr length, GLbitfield access);
+typedef GLboolean (APIENTRYP PFNGLEXTUNMAPNAMEDBUFFERPROC)(GLuint buffer);
+typedef void (APIENTRYP PFNGLEXTCREATEVERTEXARRAYSPROC)(GLsizei n, GLuint *arrays);
+typedef void (APIENTRYP PFNGLEXTENABLEVERTEXARRAYATTRIBPROC)(GLuint vaobj, GLuint index);
+typedef void (APIENTRYP PFNGLEXTVERTEXARRAYATTRIBFORMATPROC)(GLuint vaobj, GLuint attribindex, GLint size, GLenum type, GLboolean normalized, GLuint relativeoffset);
+typedef void (APIENTRYP PFNGLEXTVERTEXARRAYATTRIBBINDINGPROC)(GLuint vaobj, GLuint attribindex, GLuint bindingindex);
+typedef void (APIENTRYP PFNGLEXTVERTEXARRAYVERTEXBUFFERPROC)(GLuint vaobj, GLuint bindingindex, GLuint buffer, GLintptr offset, GLsizei stride);
+typedef void (APIENTRYP PFNGLEXTVERTEXARRAYELEMENTBUFFERPROC)(GLuint vaobj, GLuint buffer);
+typedef void (APIENTRYP PFNGLEXTCREATETEXTURESPROC)(GLenum target, GLsizei n, GLuint *textures);
+typedef void (APIENTRYP PFNGLEXTTEXTURESTORAGE2DPROC)(GLuint texture, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height);
+typedef void (APIENTRYP PFNGLEXTTEXTURESUBIMAGE2DPROC)(GLuint texture, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const void *pixels);
+typedef void (APIENTRYP PFNGLEXTTEXTURESUBIMAGE3DPROC)(GLuint texture, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const void *pixels);
+typedef void (APIENTRYP PFNGLEXTCOMPRESSEDTEXTURESUBIMAGE2DPROC)(GLuint texture, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLsizei imageSize, const void *data);
+typedef void (APIENTRYP PFNGLEXTTEXTUREPARAMETERIPROC)(GLuint texture, GLenum pname, GLint param);
+typedef void (APIENTRYP PFNGLEXTTEXTUREPARAMETERIVPROC)(GLuint texture, GLenum pname, const GLint *param);
+typedef void (APIENTRYP PFNGLEXTGENERATETEXTUREMIPMAPPROC)(GLuint texture);
+typedef void (APIENTRYP PFNGLEXTBINDTEXTUREUNITPROC)(GLuint unit, GLuint texture);
+typedef void (APIENTRYP PFNGLEXTCREATEFRAMEBUFFERSPROC)(GLsizei n, GLuint *framebuffers);
+typedef void (APIENTRYP PFNGLEXTNAMEDFRAMEBUFFERTEXTUREPROC)(GLuint framebuffer, GLenum attachment, GLuint texture, GLint level);
+typedef void (APIENTRYP PFNGLEXTNAMEDFRAMEBUFFERTEXTURELAYERPROC)(GLuint framebuffer, GLenum attachment, GLuint texture, GLint level, GLint layer);
+typedef void (APIENTRYP PFNGLEXTNAMEDFRAMEBUFFERRENDERBUFFERPROC)(GLuint framebuffer, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer);
+typedef void (APIENTRYP PFNGLEXTCREATERENDERBUFFERSPROC)(GLsizei n, GLuint *renderbuffers);
+typedef void (APIENTRYP PFNGLEXTNAMEDRENDERBUFFERSTORAGEPROC)(GLuint renderbuffer, GLenum internalformat, GLsizei width, GLsizei height);
+
+PFNGLEXTCREATEBUFFERSPROC glext_glCreateBuffers = nullptr;
+PFNGLEXTNAMEDBUFFERSTORAGEPROC glext_glNamedBufferStorage = nullptr;
+PFNGLEXTNAMEDBUFFERDATAPROC glext_glNamedBufferData = nullptr;
+PFNGLEXTNAMEDBUFFERSUBDATAPROC glext_glNamedBufferSubData = nullptr;
+PFNGLEXTCOPYNAMEDBUFFERSUBDATAPROC glext_glCopyNamedBufferSubData = nullptr;
+PFNGLEXTMAPNAMEDBUFFERRANGEPROC glext_glMapNamedBufferRange = nullptr;
+PFNGLEXTUNMAPNAMEDBUFFERPROC glext_glUnmapNamedBuffer = nullptr;
+PFNGLEXTCREATEVERTEXARRAYSPROC glext_glCreateVertexArrays = nullptr;
+PFNGLEXTENABLEVERTEXARRAYATTRIBPROC glext_glEnableVertexArrayAttrib = nullptr;
+PFNGLEXTVERTEXARRAYATTRIBFORMATPROC glext_glVertexArrayAttribFormat = nullptr;
+PFNGLEXTVERTEXARRAYATTRIBBINDINGPROC glext_glVertexArrayAttribBinding = nullptr;
+PFNGLEXTVERTEXARRAYVERTEXBUFFERPROC glext_glVertexArrayVertexBuffer = nullptr;
+PFNGLEXTVERTEXARRAYELEMENTBUFFERPROC glext_glVertexArrayElementBuffer = nullptr;
+PFNGLEXTCREATETEXTURESPROC glext_glCreateTextures = nullptr;
+PFNGLEXTTEXTURESTORAGE2DPROC glext_glTextureStorage2D = nullptr;
+PFNGLEXTTEXTURESUBIMAGE2DPROC glext_glTextureSubImage2D = nullptr;
+PFNGLEXTTEXTURESUBIMAGE3DPROC glext_glTextureSubImage3D = nullptr;
+PFNGLEXTCOMPRESSEDTEXTURESUBIMAGE2DPROC glext_glCompressedTextureSubImage2D = nullptr;
+PFNGLEXTTEXTUREPARAMETERIPROC glext_glTextureParameteri = nullptr;
+PFNGLEXTTEXTUREPARAMETERIVPROC glext_glTextureParameteriv = nullptr;
+PFNGLEXTGENERATETEXTUREMIPMAPPROC glext_glGenerateTextureMipmap = nullptr;
+PFNGLEXTBINDTEXTUREUNITPROC glext_glBindTextureUnit = nullptr;
+PFNGLEXTCREATEFRAMEBUFFERSPROC glext_glCreateFramebuffers = nullptr;
+PFNGLEXTNAMEDFRAMEBUFFERTEXTUREPROC glext_glNamedFramebufferTexture = nullptr;
+PFNGLEXTNAMEDFRAMEBUFFERTEXTURELAYERPROC glext_glNamedFramebufferTextureLayer = nullptr;
+PFNGLEXTNAMEDFRAMEBUFFERRENDERBUFFERPROC glext_glNamedFramebufferRenderbuffer = nullptr;
+PFNGLEXTCREATERENDERBUFFERSPROC glext_glCreateRenderbuffers = nullptr;
+PFNGLEXTNAMEDRENDERBUFFERSTORAGEPROC glext_glNamedRenderbufferStorage = nullptr;
+#define glCreateBuffers glext_glCreateBuffers
+#define glNamedBufferStorage glext_glNamedBufferStorage
+#define glNamedBufferData glext_glNamedBufferData
+#define glNamedBufferSubData glext_glNamedBufferSubData
+#define glCopyNamedBufferSubData glext_glCopyNamedBufferSubData
+#define glMapNamedBufferRange glext_glMapNamedBufferRange
+#define glUnmapNamedBuffer glext_glUnmapNamedBuffer
+#define glCreateVertexArrays glext_glCreateVertexArrays
+#define glEnableVertexArrayAttrib glext_glEnableVertexArrayAttrib
+#define glVertexArrayAttribFormat glext_glVertexArrayAttribFormat
+#define glVertexArrayAttribBinding glext_glVertexArrayAttribBinding
+#define glVertexArrayVertexBuffer glext_glVertexArrayVertexBuffer
+#define glVertexArrayElementBuffer glext_glVertexArrayElementBuffer
+#define glCreateTextures glext_glCreateTextures
+#define glTextureStorage2D glext_glTextureStorage2D
+#define glTextureSubImage2D glext_glTextureSubImage2D
+#define glTextureSubImage3D glext_glTextureSubImage3D
+#define glCompressedTextureSubImage2D glext_glCompressedTextureSubImage2D
+#define glTextureParameteri glext_glTextureParameteri
+#define glTextureParameteriv glext_glTextureParameteriv
+#define glGenerateTextureMipmap glext_glGenerateTextureMipmap
+#define glBindTextureUnit glext_glBindTextureUnit
+#define glCreateFramebuffers glext_glCreateFramebuffers
+#define glNamedFramebufferTexture glext_glNamedFramebufferTexture
+#define glNamedFramebufferTextureLayer glext_glNamedFramebufferTextureLayer
+#define glNamedFramebufferRenderbuffer glext_glNamedFramebufferRenderbuffer
+#define glCreateRenderbuffers glext_glCreateRenderbuffers
+#define glNamedRenderbufferStorage glext_glNamedRenderbufferStorage
+
+// EXT_texture_compression_s3tc (BC1/BC3) 和 EXT_texture_sRGB 里的sRGB版本
+// BC4/BC5(RGTC)从3.0开始就是核心功能, glad里已经有定义
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
+struct GLCapabilities
+{
+  int major;
+  int minor;
+  bool bufferStorage;   // 可以持久映射缓冲区
+  bool textureS3TC;     // 可以使用BC1/BC3
+  bool textureSRGBS3TC; // BC1/BC3有sRGB格式
+  bool programBinary;   // 可以取出和加载链接好的程序二进制(驱动至少支持一种格式)
+  bool parallelShaderCompile; // 编译链接在驱动的线程里进行, 可以不阻塞地查询是否完成
+  bool directStateAccess; // 创建和修改缓冲区、纹理、VAO、帧缓冲不需要绑定; 在loadGLExtensions之后清掉可以强制走绑定的路径
+};
+
+GLCapabilities &glCapabilities()
+{
+  static GLCapabilities caps = { 3, 3, false, false, false, false, false, false };
+  return caps;
+}
+
+bool hasGLExtension(const char *name)
+{
+  GLint count = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+  for (GLint i = 0; i < count; i++)
+  {
+    const char *extension = (const char *)glGetStringi(GL_EXTENSIONS, i);
+    if (extension && strcmp(extension, name) == 0)
+      return true;
+  }
+  return false;
+}
+
+bool hasGLVersion(int major, int minor)
+{
+  const GLCapabilities &caps = glCapabilities();
+  return caps.major > major || (caps.major == major && caps.minor >= minor);
+}
+
+void loadGLExtensions(GLADloadproc load)
+{
+  GLCapabilities &caps = glCapabilities();
+  glGetIntegerv(GL_MAJOR_VERSION, &caps.major);
+  glGetIntegerv(GL_MINOR_VERSION, &caps.minor);
+
+  if (hasGLVersion(4, 4) || hasGLExtension("GL_ARB_buffer_storage"))
+    glext_glBufferStorage = (PFNGLEXTBUFFERSTORAGEPROC)load("glBufferStorage");
+  caps.bufferStorage = glext_glBufferStorage != nullptr;
+
+  if (hasGLVersion(4, 1) || hasGLExtension("GL_ARB_get_program_binary"))
+  {
+    glext_glGetProgramBinary = (PFNGLEXTGETPROGRAMBINARYPROC)load("glGetProgramBinary");
+    glext_glProgramBinary = (PFNGLEXTPROGRAMBINARYPROC)load("glProgramBinary");
+    glext_glProgramParameteri = (PFNGLEXTPROGRAMPARAMETERIPROC)load("glProgramParameteri");
+  }
+  // 有的驱动导出了函数但一种格式都不支持, 这时取出的二进制也无法加载
+  GLint binaryFormats = 0;
+  if (glext_glGetProgramBinary && glext_glProgramBinary && glext_glProgramParameteri)
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormats);
+  caps.programBinary = binaryFormats > 0;
+
+  if (hasGLExtension("GL_KHR_parallel_shader_compile"))
+    glext_glMaxShaderCompilerThreadsKHR = (PFNGLEXTMAXSHADERCOMPILERTHREADSPROC)load("glMaxShaderCompilerThreadsKHR");
+  else if (hasGLExtension("GL_ARB_parallel_shader_compile"))
+    glext_glMaxShaderCompilerThreadsKHR = (PFNGLEXTMAXSHADERCOMPILERTHREADSPROC)load("glMaxShaderCompilerThreadsARB");
+  caps.parallelShaderCompile = glext_glMaxShaderCompilerThreadsKHR != nullptr;
+  // 0xFFFFFFFF表示由驱动决定线程数
+  if (caps.parallelShaderCompile)
+    glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);
+
+  if (hasGLVersion(4, 5) || hasGLExtension("GL_ARB_direct_state_access"))
+  {
+    glext_glCreateBuffers = (PFNGLEXTCREATEBUFFERSPROC)load("glCreateBuffers");
+    glext_glNamedBufferStorage = (PFNGLEXTNAMEDBUFFERSTORAGEPROC)load("glNamedBufferStorage");
+    glext_glNamedBufferData = (PFNGLEXTNAMEDBUFFERDATAPROC)load("glNamedBufferData");
+    glext_glNamedBufferSubData = (PFNGLEXTNAMEDBUFFERSUBDATAPROC)load("glNamedBufferSubData");
+    glext_glCopyNamedBufferSubData = (PFNGLEXTCOPYNAMEDBUFFERSUBDATAPROC)load("glCopyNamedBufferSubData");
+    glext_glMapNamedBufferRange = (PFNGLEXTMAPNAMEDBUFFERRANGEPROC)load("glMapNamedBufferRange");
+    glext_glUnmapNamedBuffer = (PFNGLEXTUNMAPNAMEDBUFFERPROC)load("glUnmapNamedBuffer");
+    glext_glCreateVertexArrays = (PFNGLEXTCREATEVERTEXARRAYSPROC)load("glCreateVertexArrays");
+    glext_glEnableVertexArrayAttrib = (PFNGLEXTENABLEVERTEXARRAYATTRIBPROC)load("glEnableVertexArrayAttrib");
+    glext_glVertexArrayAttribFormat = (PFNGLEXTVERTEXARRAYATTRIBFORMATPROC)load("glVertexArrayAttribFormat");
+    glext_glVertexArrayAttribBinding = (PFNGLEXTVERTEXARRAYATTRIBBINDINGPROC)load("glVertexArrayAttribBinding");
+    glext_glVertexArrayVertexBuffer = (PFNGLEXTVERTEXARRAYVERTEXBUFFERPROC)load("glVertexArrayVertexBuffer");
+    glext_glVertexArrayElementBuffer = (PFNGLEXTVERTEXARRAYELEMENTBUFFERPROC)load("glVertexArrayElementBuffer");
+    glext_glCreateTextures = (PFNGLEXTCREATETEXTURESPROC)load("glCreateTextures");
+    glext_glTextureStorage2D = (PFNGLEXTTEXTURESTORAGE2DPROC)load("glTextureStorage2D");
+    glext_glTextureSubImage2D = (PFNGLEXTTEXTURESUBIMAGE2DPROC)load("glTextureSubImage2D");
+    glext_glTextureSubImage3D = (PFNGLEXTTEXTURESUBIMAGE3DPROC)load("glTextureSubImage3D");
+    glext_glCompressedTextureSubImage2D = (PFNGLEXTCOMPRESSEDTEXTURESUBIMAGE2DPROC)load("glCompressedTextureSubImage2D");
+    glext_glTextureParameteri = (PFNGLEXTTEXTUREPARAMETERIPROC)load("glTextureParameteri");
+    glext_glTextureParameteriv = (PFNGLEXTTEXTUREPARAMETERIVPROC)load("glTextureParameteriv");
+    glext_glGenerateTextureMipmap = (PFNGLEXTGENERATETEXTUREMIPMAPPROC)load("glGenerateTextureMipmap");
+    glext_glBindTextureUnit = (PFNGLEXTBINDTEXTUREUNITPROC)load("glBindTextureUnit");
+    glext_glCreateFramebuffers = (PFNGLEXTCREATEFRAMEBUFFERSPROC)load("glCreateFramebuffers");
+    glext_glNamedFramebufferTexture = (PFNGLEXTNAMEDFRAMEBUFFERTEXTUREPROC)load("glNamedFramebufferTexture");
+    glext_glNamedFramebufferTextureLayer = (PFNGLEXTNAMEDFRAMEBUFFERTEXTURELAYERPROC)load("glNamedFramebufferTextureLayer");
+    glext_glNamedFramebufferRenderbuffer = (PFNGLEXTNAMEDFRAMEBUFFERRENDERBUFFERPROC)load("glNamedFramebufferRenderbuffer");
+    glext_glCreateRenderbuffers = (PFNGLEXTCREATERENDERBUFFERSPROC)load("glCreateRenderbuffers");
+    glext_glNamedRenderbufferStorage = (PFNGLEXTNAMEDRENDERBUFFERSTORAGEPROC)load("glNamedRenderbufferStorage");
+  }
+  // 只有扩展没有4.2的纹理存储时glTextureStorage2D不存在, 缺任何一个都整体不用
+  const void *directFunctions[] = {
+    (const void *)glext_glCreateBuffers, (const void *)glext_glNamedBufferStorage, (const void *)glext_glNamedBufferData,
+    (const void *)glext_glNamedBufferSubData, (const void *)glext_glCopyNamedBufferSubData, (const void *)glext_glMapNamedBufferRange,
+    (const void *)glext_glUnmapNamedBuffer, (const void *)glext_glCreateVertexArrays, (const void *)glext_glEnableVertexArrayAttrib,
+    (const void *)glext_glVertexArrayAttribFormat, (const void *)glext_glVertexArrayAttribBinding, (const void *)glext_glVertexArrayVertexBuffer,
+    (const void *)glext_glVertexArrayElementBuffer, (const void *)glext_glCreateTextures, (const void *)glext_glTextureStorage2D,
+    (const void *)glext_glTextureSubImage2D, (const void *)glext_glTextureSubImage3D, (const void *)glext_glCompressedTextureSubImage2D,
+    (const void *)glext_glTextureParameteri, (const void *)glext_glTextureParameteriv, (const void *)glext_glGenerateTextureMipmap,
+    (const void *)glext_glBindTextureUnit, (const void *)glext_glCreateFramebuffers, (const void *)glext_glNamedFramebufferTexture,
+    (const void *)glext_glNamedFramebufferTextureLayer, (const void *)glext_glNamedFramebufferRenderbuffer, (const void *)glext_glCreateRenderbuffers,
+    (const void *)glext_glNamedRenderbufferStorage
+  };
+  caps.directStateAccess = true;
+  for (size_t i = 0; i < sizeof(directFunctions) / sizeof(directFunctions[0]); i++)
+    if (directFunctions[i] == nullptr)
+      caps.directStateAccess = false;
+
+  caps.textureS3TC = hasGLExtension("GL_EXT_texture_compression_s3tc");
+  caps.textureSRGBS3TC = caps.textureS3TC && (hasGLExtension("GL_EXT_texture_sRGB") || hasGLExtension("GL_EXT_texture_compression_s3tc_srgb"));
+}
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef GL_HANDLE_H
+#define GL_HANDLE_H
+
+#include <glad/glad.h>
+
+#include <GLDirectState.h>
+
+// 只能移动的GL对象句柄, 析构时删除对象; 0表示空句柄
+// Deleter提供static void destroy(unsigned int id)
+template <class Deleter>
+class GLHandle
+{
+private:
+  unsigned int id;
+public:
+  GLHandle() : id(0) {}
+  explicit GLHandle(unsigned int handle) : id(handle) {}
+  ~GLHandle() { reset(); }
+
+  GLHandle(const GLHandle &) = delete;
+  GLHandle &operator=(const GLHandle &) = delete;
+  GLHandle(GLHandle &&other) noexcept : id(other.id) { other.id = 0; }
+  GLHandle &operator=(GLHandle &&other) noexcept
+  {
+    if (this != &other)
+    {
+      reset();
+      id = other.id;
+      other.id = 0;
+    }
+    return *this;
+  }
+
+  unsigned int get() const { return id; }
+  explicit operator bool() const { return id != 0; }
+
+  // 删除当前对象, 换成handle
+  void reset(unsigned int handle = 0)
+  {
+    if (id != 0)
+      Deleter::destroy(id);
+    id = handle;
+  }
+};
+
+struct BufferDeleter
+{
+  static void destroy(unsigned int id) { glDeleteBuffers(1, &id); }
+};
+
+struct VertexArrayDeleter
+{
+  static void destroy(unsigned int id)
+  {
+    GLState::instance().forgetVertexArray(id);
+    glDeleteVertexArrays(1, &id);
+  }
+};
+
+typedef GLHandle<BufferDeleter> GLBuffer;
+typedef GLHandle<VertexArrayDeleter> GLVertexArray;
+
+inline GLBuffer createBuffer()
+{
+  return GLBuffer(createBufferObject());
+}
+
+inline GLVertexArray createVertexArray()
+{
+  return GLVertexArray(createVertexArrayObject());
+}
+
+#endif
@@ -0,0 +1,319 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <cstring>
+
+#include <glad/glad.h>
+
+#include <GLExtensions.h>
+
+// 每帧的状态切换统计, endFrame取出并清零
+struct GLStateStats
+{
+  unsigned long long issued;   // 实际发出的GL调用
+  unsigned long long filtered; // 和当前状态相同而省掉的调用
+};
+
+// GL状态的影子副本: 程序、VAO、各纹理单元的2D/立方体贴图、帧缓冲、深度/混合状态和视口
+// 和当前值相同的调用直接丢掉; 其余的调用照常发出并记录
+// 前提是这些状态只通过这里修改, 绕过它直接调用GL之后要调用invalidate
+// 删除对象时GL会把绑定恢复成0, 删除前调用对应的forget, 否则同一个名字被重新分配后会被误判为已经绑定
+class GLState
+{
+private:
+  static const unsigned int MAX_TEXTURE_UNITS = 32;
+  static const GLuint UNKNOWN = 0xFFFFFFFFu;
+  enum TextureSlot { SLOT_2D, SLOT_CUBE_MAP, SLOT_COUNT };
+  enum Capability { CAP_DEPTH_TEST, CAP_BLEND, CAP_CULL_FACE, CAP_STENCIL_TEST, CAP_SCISSOR_TEST, CAP_FRAMEBUFFER_SRGB, CAP_COUNT };
+
+  GLuint program;
+  GLuint vertexArray;
+  GLuint drawFramebuffer;
+  GLuint readFramebuffer;
+  GLuint activeUnit; // 纹理单元的序号, 不是GL_TEXTURE0 + i
+  GLuint textures[MAX_TEXTURE_UNITS][SLOT_COUNT];
+  int capabilities[CAP_COUNT]; // -1表示未知
+  GLenum depthFunction;
+  int depthWrite;
+  GLenum blendSource;
+  GLenum blendDestination;
+  GLint viewportRect[4];
+  bool viewportKnown;
+  GLStateStats current;
+  GLStateStats last;
+
+  GLState()
+  {
+    invalidate();
+    memset(&current, 0, sizeof(current));
+    memset(&last, 0, sizeof(last));
+  }
+  GLState(const GLState &) = delete;
+  GLState &operator=(const GLState &) = delete;
+
+  static int textureSlot(GLenum target)
+  {
+    if (target == GL_TEXTURE_2D)
+      return SLOT_2D;
+    if (target == GL_TEXTURE_CUBE_MAP)
+      return SLOT_CUBE_MAP;
+    return -1;
+  }
+  static int capabilityIndex(GLenum cap)
+  {
+    switch (cap)
+    {
+    case GL_DEPTH_TEST: return CAP_DEPTH_TEST;
+    case GL_BLEND: return CAP_BLEND;
+    case GL_CULL_FACE: return CAP_CULL_FACE;
+    case GL_STENCIL_TEST: return CAP_STENCIL_TEST;
+    case GL_SCISSOR_TEST: return CAP_SCISSOR_TEST;
+    case GL_FRAMEBUFFER_SRGB: return CAP_FRAMEBUFFER_SRGB;
+    default: return -1;
+    }
+  }
+  // 记录一次调用, 返回是否需要发出
+  bool changed(bool differs)
+  {
+    if (differs)
+      current.issued++;
+    else
+      current.filtered++;
+    return differs;
+  }
+  void setCapability(GLenum cap, bool enabled);
+public:
+  static GLState &instance()
+  {
+    static GLState state;
+    return state;
+  }
+
+  // 忘掉所有记录, 下一次设置一定会发出
+  void invalidate();
+
+  void useProgram(GLuint id);
+  void bindVertexArray(GLuint id);
+  // texture是GL_TEXTURE0 + i, 和glActiveTexture一样
+  void activeTexture(GLenum texture);
+  // 绑定到当前激活的纹理单元, 和glBindTexture一样; 上传贴图时用
+  void bindTexture(GLenum target, GLuint id);
+  // 绑定到指定的纹理单元, 只有需要改绑定时才切换激活的单元; 有glBindTextureUnit时不切换; 绘制时用
+  void bindTextureUnit(unsigned int unit, GLenum target, GLuint id);
+  void bindFramebuffer(GLenum target, GLuint id);
+  void enable(GLenum cap) { setCapability(cap, true); }
+  void disable(GLenum cap) { setCapability(cap, false); }
+  void depthFunc(GLenum func);
+  void depthMask(GLboolean write);
+  void blendFunc(GLenum source, GLenum destination);
+  void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+  // 对象删除前调用, 绑定着它的记录按GL的规则恢复成0
+  void forgetTexture(GLuint id);
+  void forgetVertexArray(GLuint id);
+  void forgetProgram(GLuint id);
+  void forgetFramebuffer(GLuint id);
+
+  // 每帧结束时调用
+  void endFrame()
+  {
+    last = current;
+    memset(&current, 0, sizeof(current));
+  }
+  const GLStateStats &lastFrame() const { return last; }
+};
+
+void GLState::invalidate()
+{
+  program = UNKNOWN;
+  vertexArray = UNKNOWN;
+  drawFramebuffer = UNKNOWN;
+  readFramebuffer = UNKNOWN;
+  activeUnit = UNKNOWN;
+  for (unsigned int unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+    for (int slot = 0; slot < SLOT_COUNT; slot++)
+      textures[unit][slot] = UNKNOWN;
+  for (int i = 0; i < CAP_COUNT; i++)
+    capabilities[i] = -1;
+  depthFunction = UNKNOWN;
+  depthWrite = -1;
+  blendSource = UNKNOWN;
+  blendDestination = UNKNOWN;
+  viewportKnown = false;
+}
+
+void GLState::useProgram(GLuint id)
+{
+  if (changed(program != id))
+  {
+    glUseProgram(id);
+    program = id;
+  }
+}
+
+void GLState::bindVertexArray(GLuint id)
+{
+  if (changed(vertexArray != id))
+  {
+    glBindVertexArray(id);
+    vertexArray = id;
+  }
+}
+
+void GLState::activeTexture(GLenum texture)
+{
+  GLuint unit = texture - GL_TEXTURE0;
+  if (changed(activeUnit != unit))
+  {
+    glActiveTexture(texture);
+    activeUnit = unit;
+  }
+}
+
+void GLState::bindTexture(GLenum target, GLuint id)
+{
+  // 不知道当前激活的是哪个单元时先切到0号, 这样绑定的结果才能记录下来
+  if (activeUnit == UNKNOWN)
+    activeTexture(GL_TEXTURE0);
+  int slot = textureSlot(target);
+  if (slot < 0 || activeUnit >= MAX_TEXTURE_UNITS)
+  {
+    changed(true);
+    glBindTexture(target, id);
+    return;
+  }
+  if (changed(textures[activeUnit][slot] != id))
+  {
+    glBindTexture(target, id);
+    textures[activeUnit][slot] = id;
+  }
+}
+
+void GLState::bindTextureUnit(unsigned int unit, GLenum target, GLuint id)
+{
+  int slot = textureSlot(target);
+  if (slot >= 0 && unit < MAX_TEXTURE_UNITS && textures[unit][slot] == id)
+  {
+    changed(false);
+    return;
+  }
+  if (glCapabilities().directStateAccess)
+  {
+    // 纹理的类型在创建时就确定了, 不需要target; 绑定0会清空这个单元的所有类型
+    changed(true);
+    glBindTextureUnit(unit, id);
+    if (unit < MAX_TEXTURE_UNITS)
+    {
+      if (id == 0)
+        for (int i = 0; i < SLOT_COUNT; i++)
+          textures[unit][i] = 0;
+      else if (slot >= 0)
+        textures[unit][slot] = id;
+    }
+    return;
+  }
+  activeTexture(GL_TEXTURE0 + unit);
+  bindTexture(target, id);
+}
+
+void GLState::bindFramebuffer(GLenum target, GLuint id)
+{
+  bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+  bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+  if (changed((draw && drawFramebuffer != id) || (read && readFramebuffer != id)))
+  {
+    glBindFramebuffer(target, id);
+    if (draw)
+      drawFramebuffer = id;
+    if (read)
+      readFramebuffer = id;
+  }
+}
+
+void GLState::setCapability(GLenum cap, bool enabled)
+{
+  int index = capabilityIndex(cap);
+  if (index >= 0 && !changed(capabilities[index] != (enabled ? 1 : 0)))
+    return;
+  if (index < 0)
+    changed(true);
+  if (enabled)
+    glEnable(cap);
+  else
+    glDisable(cap);
+  if (index >= 0)
+    capabilities[index] = enabled ? 1 : 0;
+}
+
+void GLState::depthFunc(GLenum func)
+{
+  if (changed(depthFunction != func))
+  {
+    glDepthFunc(func);
+    depthFunction = func;
+  }
+}
+
+void GLState::depthMask(GLboolean write)
+{
+  int value = write ? 1 : 0;
+  if (changed(depthWrite != value))
+  {
+    glDepthMask(write);
+    depthWrite = value;
+  }
+}
+
+void GLState::blendFunc(GLenum source, GLenum destination)
+{
+  if (changed(blendSource != source || blendDestination != destination))
+  {
+    glBlendFunc(source, destination);
+    blendSource = source;
+    blendDestination = destination;
+  }
+}
+
+void GLState::viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+  if (changed(!viewportKnown || viewportRect[0] != x || viewportRect[1] != y || viewportRect[2] != width || viewportRect[3] != height))
+  {
+    glViewport(x, y, width, height);
+    viewportRect[0] = x;
+    viewportRect[1] = y;
+    viewportRect[2] = width;
+    viewportRect[3] = height;
+    viewportKnown = true;
+  }
+}
+
+void GLState::forgetTexture(GLuint id)
+{
+  for (unsigned int unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+    for (int slot = 0; slot < SLOT_COUNT; slot++)
+      if (textures[unit][slot] == id)
+        textures[unit][slot] = 0;
+}
+
+void GLState::forgetVertexArray(GLuint id)
+{
+  if (vertexArray == id)
+    vertexArray = 0;
+}
+
+void GLState::forgetProgram(GLuint id)
+{
+  // 删除当前使用的程序时GL只是标记删除, 绑定不变; 名字可能被重新分配, 所以当作未知
+  if (program == id)
+    program = UNKNOWN;
+}
+
+void GLState::forgetFramebuffer(GLuint id)
+{
+  if (drawFramebuffer == id)
+    drawFramebuffer = 0;
+  if (readFramebuffer == id)
+    readFramebuffer = 0;
+}
+
+#endif
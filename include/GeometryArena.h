@@ -0,0 +1,319 @@
+#ifndef GEOMETRY_ARENA_H
+#define GEOMETRY_ARENA_H
+
+#include <map>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <glad/glad.h>
+
+#include <GLDirectState.h>
+#include <StagingUploader.h>
+#include <VertexFormat.h>
+
+// 区间分配器, 只管理偏移, 不涉及gl调用
+// 空闲块按偏移放在有序表里, 分配时首次适配, 释放时和前后相邻的空闲块合并
+class RangeAllocator
+{
+private:
+  std::map<size_t, size_t> freeBlocks; // 偏移 -> 长度
+  size_t capacity;
+  size_t used;
+public:
+  RangeAllocator() : capacity(0), used(0) {}
+
+  // 找不到足够大的空闲块时返回false, 调用方扩容后再试
+  bool allocate(size_t size, size_t alignment, size_t &offset);
+  void free(size_t offset, size_t size);
+  // 容量扩大到newCapacity, 新增的部分作为空闲块
+  void grow(size_t newCapacity);
+
+  size_t totalCapacity() const { return capacity; }
+  size_t usedSize() const { return used; }
+  size_t largestFree() const;
+  unsigned int freeBlockCount() const { return (unsigned int)freeBlocks.size(); }
+  // 1 - 最大空闲块 / 全部空闲空间, 0表示空闲空间是连续的
+  float fragmentation() const;
+};
+
+bool RangeAllocator::allocate(size_t size, size_t alignment, size_t &offset)
+{
+  for (std::map<size_t, size_t>::iterator it = freeBlocks.begin(); it != freeBlocks.end(); ++it)
+  {
+    size_t start = (it->first + alignment - 1) / alignment * alignment;
+    size_t padding = start - it->first;
+    if (it->second < padding + size)
+      continue;
+    size_t blockStart = it->first, blockSize = it->second;
+    freeBlocks.erase(it);
+    // 对齐留下的头部和用剩下的尾部重新放回空闲表
+    if (padding > 0)
+      freeBlocks[blockStart] = padding;
+    if (blockSize > padding + size)
+      freeBlocks[start + size] = blockSize - padding - size;
+    offset = start;
+    used += size;
+    return true;
+  }
+  return false;
+}
+
+void RangeAllocator::free(size_t offset, size_t size)
+{
+  if (size == 0)
+    return;
+  used -= size;
+  std::map<size_t, size_t>::iterator next = freeBlocks.lower_bound(offset);
+  if (next != freeBlocks.begin())
+  {
+    std::map<size_t, size_t>::iterator prev = next;
+    --prev;
+    if (prev->first + prev->second == offset)
+    {
+      offset = prev->first;
+      size += prev->second;
+      freeBlocks.erase(prev);
+    }
+  }
+  if (next != freeBlocks.end() && offset + size == next->first)
+  {
+    size += next->second;
+    freeBlocks.erase(next);
+  }
+  freeBlocks[offset] = size;
+}
+
+void RangeAllocator::grow(size_t newCapacity)
+{
+  if (newCapacity <= capacity)
+    return;
+  size_t oldCapacity = capacity;
+  capacity = newCapacity;
+  // 借用free合并尾部的空闲块, 先把used加回来抵消
+  used += newCapacity - oldCapacity;
+  free(oldCapacity, newCapacity - oldCapacity);
+}
+
+size_t RangeAllocator::largestFree() const
+{
+  size_t largest = 0;
+  for (std::map<size_t, size_t>::const_iterator it = freeBlocks.begin(); it != freeBlocks.end(); ++it)
+    largest = it->second > largest ? it->second : largest;
+  return largest;
+}
+
+float RangeAllocator::fragmentation() const
+{
+  size_t freeSize = capacity - used;
+  return freeSize == 0 ? 0.0f : 1.0f - (float)largestFree() / freeSize;
+}
+
+// 网格在共享缓冲区里的位置
+struct GeometryRange
+{
+  unsigned int firstVertex;
+  unsigned int vertexCount;
+  size_t indexOffset; // 字节
+  size_t indexBytes;
+};
+
+// 几何体池: 每种顶点格式一个大顶点缓冲和一个大索引缓冲, 所有网格共用同一个VAO, 用glDrawElementsBaseVertex按自己的区间绘制
+// 只有位置的顶点缓冲和深度VAO等到第一个带位置流的网格放进来时才分配, 在那之前放进来的网格没有这份数据
+// 空间不够时按2倍扩容, 用glCopyBufferSubData搬运旧数据, VAO的id不变, 已有网格的区间也不变
+class GeometryArena
+{
+private:
+  VertexFormat format;
+  unsigned int vao, depthVao;
+  unsigned int vertexBuffer, positionBuffer, indexBuffer;
+  bool positionStream; // 是否分配了只有位置的顶点缓冲
+  RangeAllocator vertices; // 单位是顶点
+  RangeAllocator indices;  // 单位是字节
+
+  explicit GeometryArena(VertexFormat vertexFormat) : format(vertexFormat), vao(0), depthVao(0), vertexBuffer(0), positionBuffer(0), indexBuffer(0), positionStream(false) {}
+  GeometryArena(const GeometryArena &) = delete;
+  GeometryArena &operator=(const GeometryArena &) = delete;
+
+  static unsigned int resizeBuffer(unsigned int buffer, size_t oldSize, size_t newSize);
+  void growVertices(size_t needed);
+  void growIndices(size_t needed);
+  void bindVertexArrays();
+public:
+  // 初始容量: 64K个顶点, 1MB索引
+  static const size_t INITIAL_VERTICES = 64 * 1024;
+  static const size_t INITIAL_INDEX_BYTES = 1024 * 1024;
+
+  static GeometryArena &instance(VertexFormat format)
+  {
+    static GeometryArena floatArena(VERTEX_FLOAT);
+    static GeometryArena packedArena(VERTEX_PACKED);
+    return format == VERTEX_PACKED ? packedArena : floatArena;
+  }
+
+  // 分配vertexCount个顶点和indexBytes字节的索引; 索引按4字节对齐, 16位和32位索引可以混放
+  void allocate(unsigned int vertexCount, size_t indexBytes, GeometryRange &range);
+  void free(const GeometryRange &range);
+  // 分配只有位置的顶点缓冲和深度VAO, 之后扩容时一起扩; 已经分配过时什么也不做
+  void enablePositionStream();
+  // 上传完整顶点、只有位置的顶点和索引, 都是已经按格式排好的数据; positionData为空时不上传位置
+  void upload(const GeometryRange &range, const void *vertexData, const void *positionData, const void *indexData);
+
+  unsigned int vertexArray() const { return vao; }
+  // 没有分配只有位置的顶点缓冲时为0
+  unsigned int depthVertexArray() const { return depthVao; }
+
+  void printReport() const;
+  static void printReports()
+  {
+    instance(VERTEX_FLOAT).printReport();
+    instance(VERTEX_PACKED).printReport();
+  }
+};
+
+// 池里区间的所有权, 只能移动, 析构时归还给对应格式的池
+class GeometryAllocation
+{
+private:
+  VertexFormat format;
+  GeometryRange range;
+  bool valid;
+public:
+  GeometryAllocation() : format(VERTEX_FLOAT), range(), valid(false) {}
+  GeometryAllocation(VertexFormat vertexFormat, unsigned int vertexCount, size_t indexBytes) : format(vertexFormat), valid(true)
+  {
+    GeometryArena::instance(format).allocate(vertexCount, indexBytes, range);
+  }
+  ~GeometryAllocation() { reset(); }
+
+  GeometryAllocation(const GeometryAllocation &) = delete;
+  GeometryAllocation &operator=(const GeometryAllocation &) = delete;
+  GeometryAllocation(GeometryAllocation &&other) noexcept : format(other.format), range(other.range), valid(other.valid) { other.valid = false; }
+  GeometryAllocation &operator=(GeometryAllocation &&other) noexcept
+  {
+    if (this != &other)
+    {
+      reset();
+      format = other.format;
+      range = other.range;
+      valid = other.valid;
+      other.valid = false;
+    }
+    return *this;
+  }
+
+  const GeometryRange &get() const { return range; }
+  explicit operator bool() const { return valid; }
+
+  void reset()
+  {
+    if (valid)
+      GeometryArena::instance(format).free(range);
+    valid = false;
+  }
+};
+
+unsigned int GeometryArena::resizeBuffer(unsigned int buffer, size_t oldSize, size_t newSize)
+{
+  // 没有直接访问时只用COPY_READ/COPY_WRITE绑定点, 不影响当前VAO记录的索引缓冲
+  unsigned int resized = createBufferObject();
+  namedBufferData(resized, newSize, nullptr, GL_STATIC_DRAW);
+  if (buffer != 0)
+  {
+    if (oldSize > 0)
+      copyNamedBufferSubData(buffer, resized, 0, 0, oldSize);
+    glDeleteBuffers(1, &buffer);
+  }
+  return resized;
+}
+
+void GeometryArena::growVertices(size_t needed)
+{
+  size_t oldCapacity = vertices.totalCapacity();
+  size_t capacity = oldCapacity > 0 ? oldCapacity * 2 : INITIAL_VERTICES;
+  while (capacity < vertices.usedSize() + needed)
+    capacity *= 2;
+  vertexBuffer = resizeBuffer(vertexBuffer, oldCapacity * vertexStride(format), capacity * vertexStride(format));
+  if (positionStream)
+    positionBuffer = resizeBuffer(positionBuffer, oldCapacity * positionStride(format), capacity * positionStride(format));
+  vertices.grow(capacity);
+  bindVertexArrays();
+}
+
+void GeometryArena::growIndices(size_t needed)
+{
+  size_t oldCapacity = indices.totalCapacity();
+  size_t capacity = oldCapacity > 0 ? oldCapacity * 2 : INITIAL_INDEX_BYTES;
+  while (capacity < indices.usedSize() + needed + 4)
+    capacity *= 2;
+  indexBuffer = resizeBuffer(indexBuffer, oldCapacity, capacity);
+  indices.grow(capacity);
+  bindVertexArrays();
+}
+
+void GeometryArena::bindVertexArrays()
+{
+  if (vao == 0)
+    vao = createVertexArrayObject();
+  if (positionStream && depthVao == 0)
+    depthVao = createVertexArrayObject();
+  // 缓冲区换了以后两个VAO都要重新指向新的缓冲区
+  setupVertexArray(vao, format, false, vertexBuffer, indexBuffer);
+  if (positionStream)
+    setupVertexArray(depthVao, format, true, positionBuffer, indexBuffer);
+}
+
+void GeometryArena::enablePositionStream()
+{
+  if (positionStream)
+    return;
+  positionStream = true;
+  // 还没有分配过顶点缓冲时等第一次扩容一起分配
+  if (vertices.totalCapacity() == 0)
+    return;
+  positionBuffer = resizeBuffer(0, 0, vertices.totalCapacity() * positionStride(format));
+  bindVertexArrays();
+}
+
+void GeometryArena::allocate(unsigned int vertexCount, size_t indexBytes, GeometryRange &range)
+{
+  size_t firstVertex;
+  while (!vertices.allocate(vertexCount, 1, firstVertex))
+    growVertices(vertexCount);
+  while (!indices.allocate(indexBytes, 4, range.indexOffset))
+    growIndices(indexBytes);
+  range.firstVertex = (unsigned int)firstVertex;
+  range.vertexCount = vertexCount;
+  range.indexBytes = indexBytes;
+}
+
+void GeometryArena::free(const GeometryRange &range)
+{
+  vertices.free(range.firstVertex, range.vertexCount);
+  indices.free(range.indexOffset, range.indexBytes);
+}
+
+void GeometryArena::upload(const GeometryRange &range, const void *vertexData, const void *positionData, const void *indexData)
+{
+  StagingUploader &uploader = StagingUploader::instance();
+  uploader.bufferSubData(vertexBuffer, (size_t)range.firstVertex * vertexStride(format), vertexData, (size_t)range.vertexCount * vertexStride(format));
+  if (positionData && positionStream)
+    uploader.bufferSubData(positionBuffer, (size_t)range.firstVertex * positionStride(format), positionData, (size_t)range.vertexCount * positionStride(format));
+  uploader.bufferSubData(indexBuffer, range.indexOffset, indexData, range.indexBytes);
+}
+
+void GeometryArena::printReport() const
+{
+  if (vertices.totalCapacity() == 0)
+    return;
+  size_t stride = vertexStride(format) + (positionStream ? positionStride(format) : 0);
+  // 先拼成一行, 不改变std::cout的格式状态
+  std::ostringstream line;
+  line << std::fixed << std::setprecision(1) << "ARENA::" << (format == VERTEX_PACKED ? "packed" : "float")
+       << " vertices " << vertices.usedSize() * stride / 1024 << "/" << vertices.totalCapacity() * stride / 1024 << " KB ("
+       << vertices.freeBlockCount() << " free blocks, " << vertices.fragmentation() * 100.0f << "% fragmented), indices "
+       << indices.usedSize() / 1024 << "/" << indices.totalCapacity() / 1024 << " KB ("
+       << indices.freeBlockCount() << " free blocks, " << indices.fragmentation() * 100.0f << "% fragmented)";
+  std::cout << line.str() << std::endl;
+}
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+#include <cstring>
+#include <stdint.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// 只读的内存映射文件, 缓存文件直接从这里把数据交给glBufferData, 不需要再拷贝一遍
+class MappedFile
+{
+private:
+  const unsigned char *bytes;
+  size_t length;
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+public:
+  MappedFile() : bytes(nullptr), length(0) {}
+  ~MappedFile() { close(); }
+
+  bool open(const std::string &path)
+  {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+      ::close(fd);
+      return false;
+    }
+    void *mapped = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // 映射建立后就可以关掉文件描述符了
+    ::close(fd);
+    if (mapped == MAP_FAILED)
+      return false;
+    bytes = (const unsigned char *)mapped;
+    length = (size_t)st.st_size;
+    return true;
+  }
+
+  void close()
+  {
+    if (bytes)
+      munmap((void *)bytes, length);
+    bytes = nullptr;
+    length = 0;
+  }
+
+  bool isOpen() const { return bytes != nullptr; }
+  const unsigned char *data() const { return bytes; }
+  size_t size() const { return length; }
+};
+
+// 源文件的大小和修改时间(纳秒), 用来快速判断缓存是否过期
+struct FileStamp
+{
+  uint64_t size;
+  int64_t mtime;
+};
+
+inline bool statFile(const std::string &path, FileStamp &stamp)
+{
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0)
+    return false;
+  stamp.size = (uint64_t)st.st_size;
+  // 用纳秒精度, 同一秒内的修改也能发现
+#ifdef __APPLE__
+  stamp.mtime = (int64_t)st.st_mtimespec.tv_sec * 1000000000LL + st.st_mtimespec.tv_nsec;
+#else
+  stamp.mtime = (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+  return true;
+}
+
+// 64位内容哈希, 每次处理8个字节, 比逐字节的FNV快很多, 用来比较文件内容是否相同
+inline uint64_t hashBytes(const void *data, size_t size, uint64_t seed = 0x9E3779B97F4A7C15ULL)
+{
+  const uint64_t m = 0xC6A4A7935BD1E995ULL;
+  const unsigned char *p = (const unsigned char *)data;
+  uint64_t h = seed ^ (size * m);
+  size_t blocks = size / 8;
+  for (size_t i = 0; i < blocks; i++)
+  {
+    uint64_t k;
+    memcpy(&k, p + i * 8, 8);
+    k *= m;
+    k ^= k >> 47;
+    k *= m;
+    h ^= k;
+    h *= m;
+  }
+  const unsigned char *tail = p + blocks * 8;
+  uint64_t k = 0;
+  for (size_t i = 0; i < (size & 7); i++)
+    k |= (uint64_t)tail[i] << (8 * i);
+  h ^= k;
+  h *= m;
+  h ^= h >> 47;
+  h *= m;
+  h ^= h >> 47;
+  return h;
+}
+
+inline bool hashFile(const std::string &path, uint64_t &hash)
+{
+  MappedFile file;
+  if (!file.open(path))
+    return false;
+  hash = hashBytes(file.data(), file.size());
+  return true;
+}
+
+#endif
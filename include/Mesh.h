@@ -1,17 +1,23 @@
 #ifndef MESH_H
 #define MESH_H
 
+#include <cmath>
 #include <string>
 #include <vector>
+#include <utility>
+#include <cstring>
+#include <stdint.h>
+#include <glad/glad.h>
 #include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
 
-// 顶点
-struct Vertex
-{
-  glm::vec3 Position;
-  glm::vec3 Normal;
-  glm::vec2 TexCoords;
-};
+#include <GeometryArena.h>
+#include <GLHandle.h>
+#include <GLState.h>
+#include <Meshlet.h>
+#include <Shader.h>
+#include <StagingUploader.h>
+#include <VertexFormat.h>
 
 struct Texture
 {
@@ -20,78 +26,475 @@ struct Texture
   std::string path;
 };
 
+// 一级LOD在索引缓冲里的范围, 所有层级共用同一份顶点
+// error是简化带来的模型空间几何误差, 绘制时按投影到屏幕上的像素数选择层级
+struct MeshLod
+{
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  float error;
+};
+
+// 距离为1处一个模型单位投影到屏幕上的像素数, zoom是Camera::Zoom(垂直视角, 度), 视口或视角变化时重新计算
+inline float lodProjectionScale(float zoom, float viewportHeight)
+{
+  return viewportHeight / (2.0f * std::tan(glm::radians(zoom) * 0.5f));
+}
+
+// 网格的CPU数据, 不涉及任何gl调用, 可以在工作线程中生成
+struct MeshData
+{
+  std::vector<Vertex> vertices;
+  std::vector<unsigned int> indices;
+  std::vector<Texture> textures; // 只有type和path, id在GL线程加载贴图时才填上
+  std::vector<Meshlet> meshlets;
+  // 为空表示只有一级; 否则indices里依次放着各级的索引, lods[0]是原始网格
+  std::vector<MeshLod> lods;
+};
+
 class Mesh
 {
 private:
-  void setupMesh();
+  // 在共享几何体池里的区间, 不在池里时为空
+  GeometryAllocation allocation;
+  // 不在池里时自己的VAO和缓冲区
+  GLVertexArray ownVertexArray, ownDepthVertexArray;
+  GLBuffer vertexBuffer, indexBuffer, positionBuffer;
+  // 每张贴图对应的采样器uniform("material.texture_diffuse1"等)在Shader里登记的序号, 第一次绘制时生成,
+  // 之后不再拼字符串, 每个着色器也只按名字查一次
+  std::vector<unsigned int> samplerIds;
+
+  void setupMesh(const Vertex *vertexData, unsigned int vertexCount, const unsigned int *indexData, unsigned int indexCount);
+  void setupOwnBuffers(const void *vertexBytes, const void *positionBytes, unsigned int vertexCount, const void *indexBytes, size_t indexBytesSize);
+  void computeBounds(const Vertex *vertexData, unsigned int vertexCount);
+  void quantizePosition(const glm::vec3 &position, uint16_t *out) const;
+  void setupSamplerIds();
+  static unsigned int positionOffsetId()
+  {
+    static unsigned int id = Shader::uniformId("positionOffset");
+    return id;
+  }
+  static unsigned int positionScaleId()
+  {
+    static unsigned int id = Shader::uniformId("positionScale");
+    return id;
+  }
+  // 绑定贴图/VAO和设置还原参数
+  void beginDraw(Shader &shader);
+  void endDraw(Shader &shader);
 public:
-  // 网格数据
-  unsigned int VAO, VBO, EBO;
+  // 绘制用的VAO, 不拥有所有权; 在共享几何体池里时是池的VAO
+  unsigned int VAO;
+  // 只读位置的紧密顶点流对应的VAO, 深度/阴影pass用; 没有开启时为0
+  unsigned int depthVAO;
+  // 绘制用的索引数量(有LOD时是LOD0的数量)
+  unsigned int indexCount;
+  // 顶点少于65536个时GPU上用16位索引, 索引缓冲小一半
+  GLenum indexType;
+  // glDrawElementsBaseVertex的参数: 索引在索引缓冲里的字节偏移和第一个顶点的位置
+  size_t indexOffset;
+  GLint baseVertex;
+  // 顶点格式和位置的还原参数, VERTEX_FLOAT时是(0, 0, 0)和(1, 1, 1)
+  VertexFormat format;
+  glm::vec3 positionOffset;
+  glm::vec3 positionScale;
+  // 模型空间的包围球, 用来估计LOD的屏幕误差
+  glm::vec3 boundsCenter;
+  float boundsRadius;
+  // CPU端的几何数据, 只有keepCpuGeometry为true时保留, 否则上传后为空
   std::vector<Vertex> vertices;
   std::vector<unsigned int> indices;
   std::vector<Texture> textures;
+  // 导入时生成的网格簇, 为空时DrawCulled退化成Draw
+  std::vector<Meshlet> meshlets;
+  // 导入时生成的LOD链, 和LOD0在同一个索引缓冲里
+  std::vector<MeshLod> lods;
+
+  // 是否额外上传一份只有位置的顶点流, 多占每顶点12字节(压缩格式8字节)显存; 有深度预pass或阴影pass时再打开
+  static bool positionStreamEnabled;
+  // 是否放进共享的几何体池(GeometryArena), 池里的网格也只在positionStreamEnabled时带有只有位置的顶点流
+  static bool arenaEnabled;
+  // DrawCulled是否做法线锥背面剔除, 双面绘制的网格要关掉
+  static bool meshletConeCulling;
+  // 选择LOD时允许的屏幕误差, 单位是像素
+  static float lodPixelError;
+  // 上传后是否保留vertices/indices; 绘制、剔除和LOD选择只需要包围球和数量
+  static bool keepCpuGeometry;
 
-  Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures);
-  void Draw(Shader shader);
+  // 参数按值传入, 调用方std::move进来时不发生拷贝
+  Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures, VertexFormat format = VERTEX_FLOAT);
+  // 导入结果整个移动进来, 包括网格簇和LOD链
+  Mesh(MeshData &&data, std::vector<Texture> textures, VertexFormat format = VERTEX_FLOAT);
+  // 直接从外部内存(比如映射的缓存文件)上传, keepCpuGeometry为true时拷贝一份CPU端副本
+  Mesh(const Vertex *vertexData, unsigned int vertexCount, const unsigned int *indexData, unsigned int indexCount, std::vector<Texture> textures, VertexFormat format = VERTEX_FLOAT);
+  // GL资源只能有一个所有者, Mesh只能移动
+  Mesh(const Mesh &) = delete;
+  Mesh &operator=(const Mesh &) = delete;
+  Mesh(Mesh &&) = default;
+  Mesh &operator=(Mesh &&) = default;
+  void Draw(Shader &shader);
+  // 按簇剔除后用glMultiDrawElementsBaseVertex只画留下的簇, 统计记在MeshletStats里
+  void DrawCulled(Shader &shader, const glm::mat4 &projectionView, const glm::mat4 &model, const glm::vec3 &cameraPosition);
+  // 设置LOD链, 索引缓冲里要已经包含所有层级; Draw之后只画LOD0
+  void setLods(const MeshLod *levels, unsigned int count);
+  // projectionScale见lodProjectionScale, 返回屏幕误差不超过lodPixelError的最粗层级
+  unsigned int selectLod(const glm::mat4 &model, const glm::vec3 &cameraPosition, float projectionScale) const;
+  void DrawLod(Shader &shader, unsigned int lod);
+  // 提前归还GL资源(池里的区间或者自己的缓冲区), 析构时也会自动归还
+  void release();
 };
 
-Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures)
+bool Mesh::positionStreamEnabled = false;
+bool Mesh::arenaEnabled = true;
+bool Mesh::meshletConeCulling = true;
+float Mesh::lodPixelError = 1.0f;
+bool Mesh::keepCpuGeometry = false;
+
+Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures, VertexFormat format)
 {
-  this->vertices = vertices;
-  this->indices = indices;
-  this->textures = textures;
+  this->format = format;
+  this->textures = std::move(textures);
 
-  setupMesh();
+  setupMesh(vertices.data(), vertices.size(), indices.data(), indices.size());
+  if (keepCpuGeometry)
+  {
+    this->vertices = std::move(vertices);
+    this->indices = std::move(indices);
+  }
 }
 
-void Mesh::setupMesh()
+Mesh::Mesh(MeshData &&data, std::vector<Texture> textures, VertexFormat format)
 {
-  glGenVertexArrays(1, &VAO);
-  glGenBuffers(1, &VBO);
-  glGenBuffers(1, &EBO);
+  this->format = format;
+  this->textures = std::move(textures);
+  meshlets = std::move(data.meshlets);
 
-  glBindVertexArray(VAO);
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  setupMesh(data.vertices.data(), data.vertices.size(), data.indices.data(), data.indices.size());
+  if (!data.lods.empty())
+    setLods(&data.lods[0], (unsigned int)data.lods.size());
+  if (keepCpuGeometry)
+  {
+    vertices = std::move(data.vertices);
+    indices = std::move(data.indices);
+  }
+  // 不保留时也要释放调用方MeshData里的副本
+  std::vector<Vertex>().swap(data.vertices);
+  std::vector<unsigned int>().swap(data.indices);
+}
 
-  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+Mesh::Mesh(const Vertex *vertexData, unsigned int vertexCount, const unsigned int *indexData, unsigned int indexCount, std::vector<Texture> textures, VertexFormat format)
+{
+  this->format = format;
+  this->textures = std::move(textures);
+
+  setupMesh(vertexData, vertexCount, indexData, indexCount);
+  if (keepCpuGeometry)
+  {
+    vertices.assign(vertexData, vertexData + vertexCount);
+    indices.assign(indexData, indexData + indexCount);
+  }
+}
+
+void Mesh::setupMesh(const Vertex *vertexData, unsigned int vertexCount, const unsigned int *indexData, unsigned int indexCount)
+{
+  this->indexCount = indexCount;
+  positionOffset = glm::vec3(0.0f);
+  positionScale = glm::vec3(1.0f);
+  VAO = depthVAO = 0;
+  indexOffset = 0;
+  baseVertex = 0;
+
+  // 先按格式把顶点、位置和索引准备成要上传的字节
+  const void *vertexBytes = vertexData;
+  std::vector<PackedVertex> packed;
+  computeBounds(vertexData, vertexCount);
+  if (format == VERTEX_PACKED)
+  {
+    packed.resize(vertexCount);
+    for (unsigned int i = 0; i < vertexCount; i++)
+    {
+      quantizePosition(vertexData[i].Position, packed[i].Position);
+      packed[i].Normal = glm::packSnorm3x10_1x2(glm::vec4(vertexData[i].Normal, 0.0f));
+      packed[i].TexCoords[0] = glm::packHalf1x16(vertexData[i].TexCoords.x);
+      packed[i].TexCoords[1] = glm::packHalf1x16(vertexData[i].TexCoords.y);
+      packed[i].Tangent = glm::packSnorm3x10_1x2(vertexData[i].Tangent);
+    }
+    vertexBytes = packed.data();
+  }
+
+  const void *positionBytes = nullptr;
+  std::vector<uint16_t> packedPositions;
+  std::vector<glm::vec3> positions;
+  if (positionStreamEnabled)
+  {
+    if (format == VERTEX_PACKED)
+    {
+      packedPositions.resize(vertexCount * 4);
+      for (unsigned int i = 0; i < vertexCount; i++)
+        memcpy(&packedPositions[i * 4], packed[i].Position, sizeof(packed[i].Position));
+      positionBytes = packedPositions.data();
+    }
+    else
+    {
+      positions.resize(vertexCount);
+      for (unsigned int i = 0; i < vertexCount; i++)
+        positions[i] = vertexData[i].Position;
+      positionBytes = positions.data();
+    }
+  }
+
+  const void *indexBytes = indexData;
+  size_t indexBytesSize = indexCount * sizeof(unsigned int);
+  std::vector<unsigned short> shortIndices;
+  indexType = GL_UNSIGNED_INT;
+  if (vertexCount < 65536)
+  {
+    indexType = GL_UNSIGNED_SHORT;
+    shortIndices.assign(indexData, indexData + indexCount);
+    indexBytes = shortIndices.data();
+    indexBytesSize = indexCount * sizeof(unsigned short);
+  }
+
+  if (arenaEnabled)
+  {
+    // 池里的索引是相对于自己第一个顶点的, 所以16位索引仍然可用
+    GeometryArena &arena = GeometryArena::instance(format);
+    if (positionBytes)
+      arena.enablePositionStream();
+    allocation = GeometryAllocation(format, vertexCount, indexBytesSize);
+    arena.upload(allocation.get(), vertexBytes, positionBytes, indexBytes);
+    VAO = arena.vertexArray();
+    depthVAO = positionBytes ? arena.depthVertexArray() : 0;
+    indexOffset = allocation.get().indexOffset;
+    baseVertex = (GLint)allocation.get().firstVertex;
+    return;
+  }
+  setupOwnBuffers(vertexBytes, positionBytes, vertexCount, indexBytes, indexBytesSize);
+}
 
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size()*sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+void Mesh::setupOwnBuffers(const void *vertexBytes, const void *positionBytes, unsigned int vertexCount, const void *indexBytes, size_t indexBytesSize)
+{
+  ownVertexArray = createVertexArray();
+  vertexBuffer = createBuffer();
+  indexBuffer = createBuffer();
+  VAO = ownVertexArray.get();
 
-  glEnableVertexAttribArray(0);
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-  glEnableVertexAttribArray(1);
-  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-  glEnableVertexAttribArray(2);
-  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+  // 开启暂存上传时经过PBO环拷贝, 否则等同于glBufferData; 都不需要事先绑定
+  StagingUploader &uploader = StagingUploader::instance();
+  uploader.bufferData(vertexBuffer.get(), vertexBytes, vertexCount * vertexStride(format), GL_STATIC_DRAW);
+  uploader.bufferData(indexBuffer.get(), indexBytes, indexBytesSize, GL_STATIC_DRAW);
+  setupVertexArray(VAO, format, false, vertexBuffer.get(), indexBuffer.get());
 
-  glBindVertexArray(0);
+  if (!positionBytes)
+    return;
+  ownDepthVertexArray = createVertexArray();
+  positionBuffer = createBuffer();
+  depthVAO = ownDepthVertexArray.get();
+  uploader.bufferData(positionBuffer.get(), positionBytes, vertexCount * positionStride(format), GL_STATIC_DRAW);
+  // 和主VAO共用同一个索引缓冲
+  setupVertexArray(depthVAO, format, true, positionBuffer.get(), indexBuffer.get());
 }
 
-void Mesh::Draw(Shader shader)
+void Mesh::computeBounds(const Vertex *vertexData, unsigned int vertexCount)
+{
+  // 包围球取包围盒的外接球; 压缩格式的位置按包围盒量化, 包围盒某个方向厚度为0时scale取1, 避免除以0
+  glm::vec3 minimum(0.0f), maximum(0.0f);
+  if (vertexCount > 0)
+    minimum = maximum = vertexData[0].Position;
+  for (unsigned int i = 1; i < vertexCount; i++)
+  {
+    minimum = glm::min(minimum, vertexData[i].Position);
+    maximum = glm::max(maximum, vertexData[i].Position);
+  }
+  boundsCenter = (minimum + maximum) * 0.5f;
+  boundsRadius = glm::length(maximum - minimum) * 0.5f;
+  if (format != VERTEX_PACKED)
+    return;
+  positionOffset = minimum;
+  positionScale = maximum - minimum;
+  for (int c = 0; c < 3; c++)
+    if (positionScale[c] <= 0.0f)
+      positionScale[c] = 1.0f;
+}
+
+void Mesh::quantizePosition(const glm::vec3 &position, uint16_t *out) const
+{
+  glm::vec3 normalized = (position - positionOffset) / positionScale;
+  for (int c = 0; c < 3; c++)
+    out[c] = (uint16_t)(glm::clamp(normalized[c], 0.0f, 1.0f) * 65535.0f + 0.5f);
+  out[3] = 0;
+}
+
+void Mesh::setupSamplerIds()
 {
   unsigned int diffuseNr = 1;
   unsigned int specularNr = 1;
   unsigned int reflectionNr = 1;
+  samplerIds.clear();
   for (unsigned int i = 0; i < textures.size(); i++)
   {
-    glActiveTexture(GL_TEXTURE0 + i);
     std::string number;
-    std::string name = textures[i].type;
+    const std::string &name = textures[i].type;
     if(name == "texture_diffuse")
       number = std::to_string(diffuseNr++);
     else if (name == "texture_specular")
       number = std::to_string(specularNr++);
     else if (name == "texture_reflection")
       number = std::to_string(reflectionNr++);
-    shader.setFloat(("material." + name + number).c_str(), i);
-    glBindTexture(GL_TEXTURE_2D, textures[i].id);
+    samplerIds.push_back(Shader::uniformId("material." + name + number));
+  }
+}
+
+void Mesh::beginDraw(Shader &shader)
+{
+  // 只读位置的着色器(阴影、深度pre-pass)走只有位置的顶点流, 也不需要绑定贴图
+  // 只有压缩格式需要还原参数, 未压缩的网格用着色器里的默认值
+  if (format == VERTEX_PACKED)
+  {
+    shader.set(shader.uniform<glm::vec3>(positionOffsetId()), positionOffset);
+    shader.set(shader.uniform<glm::vec3>(positionScaleId()), positionScale);
+  }
+  if (depthVAO != 0 && shader.usesPositionOnly())
+  {
+    GLState::instance().bindVertexArray(depthVAO);
+    return;
+  }
+
+  if (samplerIds.size() != textures.size())
+    setupSamplerIds();
+  // 相同材质的网格连续绘制时贴图绑定全部被状态缓存过滤掉
+  GLState &state = GLState::instance();
+  for (unsigned int i = 0; i < textures.size(); i++)
+  {
+    shader.set(shader.uniform<int>(samplerIds[i]), (int)i);
+    state.bindTextureUnit(i, GL_TEXTURE_2D, textures[i].id);
+  }
+
+  state.bindVertexArray(VAO);
+}
+
+void Mesh::endDraw(Shader &shader)
+{
+  // 不解绑VAO, 下一次绘制直接切换; 之后修改GL_ELEMENT_ARRAY_BUFFER绑定的代码要先绑定自己的VAO
+  // 同一个着色器还会画未压缩的网格和立方体等非Mesh物体, 压缩格式设置的还原参数画完要恢复成默认值
+  if (format == VERTEX_PACKED)
+  {
+    shader.set(shader.uniform<glm::vec3>(positionOffsetId()), glm::vec3(0.0f));
+    shader.set(shader.uniform<glm::vec3>(positionScaleId()), glm::vec3(1.0f));
+  }
+}
+
+void Mesh::Draw(Shader &shader)
+{
+  beginDraw(shader);
+  glDrawElementsBaseVertex(GL_TRIANGLES, indexCount, indexType, (void*)indexOffset, baseVertex);
+  endDraw(shader);
+}
+
+void Mesh::setLods(const MeshLod *levels, unsigned int count)
+{
+  lods.assign(levels, levels + count);
+  if (!lods.empty())
+    indexCount = lods[0].indexCount;
+}
+
+unsigned int Mesh::selectLod(const glm::mat4 &model, const glm::vec3 &cameraPosition, float projectionScale) const
+{
+  if (lods.size() < 2)
+    return 0;
+  // 误差随model的最大缩放放大; 距离取到包围球表面, 相机在包围球里时用LOD0
+  float scale = glm::max(glm::length(glm::vec3(model[0])), glm::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+  glm::vec3 center = glm::vec3(model * glm::vec4(boundsCenter, 1.0f));
+  float distance = glm::length(center - cameraPosition) - boundsRadius * scale;
+  if (distance <= 0.0f)
+    return 0;
+  unsigned int lod = 0;
+  while (lod + 1 < lods.size() && lods[lod + 1].error * scale / distance * projectionScale <= lodPixelError)
+    lod++;
+  return lod;
+}
+
+void Mesh::DrawLod(Shader &shader, unsigned int lod)
+{
+  if (lod == 0 || lod >= lods.size())
+  {
+    Draw(shader);
+    return;
   }
-  glActiveTexture(GL_TEXTURE0);
+  size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+  beginDraw(shader);
+  glDrawElementsBaseVertex(GL_TRIANGLES, lods[lod].indexCount, indexType, (void*)(indexOffset + lods[lod].firstIndex * indexSize), baseVertex);
+  endDraw(shader);
+}
+
+void Mesh::DrawCulled(Shader &shader, const glm::mat4 &projectionView, const glm::mat4 &model, const glm::vec3 &cameraPosition)
+{
+  if (meshlets.empty())
+  {
+    Draw(shader);
+    return;
+  }
+
+  // 在模型空间里剔除: 视锥平面从MVP提取, 相机位置变换到模型空间
+  // 法线锥的测试假设model矩阵没有非均匀缩放
+  Frustum frustum(projectionView * model);
+  glm::vec3 eye = glm::vec3(glm::inverse(model) * glm::vec4(cameraPosition, 1.0f));
+  MeshletStats &stats = MeshletStats::current();
+  size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
 
-  glBindVertexArray(VAO);
-  glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-  glBindVertexArray(0);
+  // 留下的簇在索引缓冲里相邻时合并成一段, 减少多重绘制的段数
+  static std::vector<GLsizei> counts;
+  static std::vector<const void *> offsets;
+  static std::vector<GLint> baseVertices;
+  counts.clear();
+  offsets.clear();
+  baseVertices.clear();
+  uint32_t rangeEnd = 0;
+  for (unsigned int i = 0; i < meshlets.size(); i++)
+  {
+    const Meshlet &meshlet = meshlets[i];
+    stats.meshlets++;
+    stats.triangles += meshlet.indexCount / 3;
+    if (!frustum.intersects(meshlet.center, meshlet.radius))
+    {
+      stats.frustumCulled++;
+      continue;
+    }
+    if (meshletConeCulling && meshlet.backfacing(eye))
+    {
+      stats.coneCulled++;
+      continue;
+    }
+    stats.submitted += meshlet.indexCount / 3;
+    if (!counts.empty() && rangeEnd == meshlet.firstIndex)
+      counts.back() += meshlet.indexCount;
+    else
+    {
+      counts.push_back(meshlet.indexCount);
+      offsets.push_back((const void *)(indexOffset + meshlet.firstIndex * indexSize));
+      baseVertices.push_back(baseVertex);
+    }
+    rangeEnd = meshlet.firstIndex + meshlet.indexCount;
+  }
+  if (counts.empty())
+    return;
+
+  stats.draws += counts.size();
+  beginDraw(shader);
+  glMultiDrawElementsBaseVertex(GL_TRIANGLES, &counts[0], indexType, &offsets[0], (GLsizei)counts.size(), &baseVertices[0]);
+  endDraw(shader);
+}
+
+void Mesh::release()
+{
+  allocation.reset();
+  ownVertexArray.reset();
+  ownDepthVertexArray.reset();
+  vertexBuffer.reset();
+  indexBuffer.reset();
+  positionBuffer.reset();
+  VAO = depthVAO = 0;
+  indexCount = 0;
 }
 
-#endif
\ No newline at end of file
+#endif
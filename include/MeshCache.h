@@ -0,0 +1,396 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+
+#include <Mesh.h>
+#include <MappedFile.h>
+
+// 模型的二进制缓存, 写在源文件旁边(xxx.obj.meshcache)
+// 文件布局: 文件头 | 网格表 | 贴图引用表 | 网格簇表 | LOD表 | 依赖文件表 | 字符串区 | 顶点数组 | 索引数组
+// 每个网格的索引包含全部LOD层级, LOD表里的firstIndex相对于网格自己的第一个索引
+// 顶点和索引按Mesh需要的格式紧密排列, 映射之后可以直接交给glBufferData
+// 修改了文件布局、Vertex结构或者导入时的处理(比如MeshOptimizer)时要增加版本号
+const uint32_t MESH_CACHE_VERSION = 7;
+
+// 导入时会改变缓存内容的开关, 记在文件头里; 和打开时传入的不同时缓存失效, 需要重新导入
+enum MeshCacheImportOption
+{
+  MESH_IMPORT_OPTIMIZE = 1 << 0, // 三角形和顶点重排
+  MESH_IMPORT_LOD = 1 << 1       // LOD链
+};
+
+struct MeshCacheHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t vertexSize;
+  // 源文件的大小、修改时间和内容哈希, 任意一个对不上都需要重新导入
+  uint64_t sourceSize;
+  int64_t sourceMtime;
+  uint64_t sourceHash;
+  uint32_t meshCount;
+  uint32_t textureCount;
+  uint32_t meshletCount;
+  uint32_t meshletSize;
+  uint32_t lodCount;
+  uint32_t lodSize;
+  uint32_t dependencyCount;
+  uint32_t importOptions; // MeshCacheImportOption的组合
+  uint64_t meshTableOffset;
+  uint64_t textureTableOffset;
+  uint64_t meshletOffset;
+  uint64_t lodOffset;
+  uint64_t dependencyOffset;
+  uint64_t stringOffset;
+  uint64_t vertexOffset;
+  uint64_t indexOffset;
+  uint64_t fileSize;
+};
+
+// 每个网格在顶点/索引数组、贴图表、网格簇表和LOD表中的范围
+struct MeshCacheEntry
+{
+  uint32_t firstVertex;
+  uint32_t vertexCount;
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  uint32_t firstTexture;
+  uint32_t textureCount;
+  uint32_t firstMeshlet;
+  uint32_t meshletCount;
+  uint32_t firstLod;
+  uint32_t lodCount;
+};
+
+struct MeshCacheTextureRef
+{
+  uint32_t typeOffset;
+  uint32_t typeLength;
+  uint32_t pathOffset;
+  uint32_t pathLength;
+};
+
+// 导入时读过的其它文件(比如.mtl材质库), 和源文件一样检查大小、修改时间和内容哈希
+// 导入时不存在的文件size为MISSING_DEPENDENCY, 之后出现了也要重新导入
+const uint64_t MISSING_DEPENDENCY = ~0ULL;
+
+struct MeshCacheDependency
+{
+  uint64_t size;
+  int64_t mtime;
+  uint64_t hash;
+  uint32_t pathOffset;
+  uint32_t pathLength;
+};
+
+class MeshCache
+{
+private:
+  MappedFile file;
+  const MeshCacheHeader *header;
+  const MeshCacheEntry *entries;
+  const MeshCacheTextureRef *textureRefs;
+  const Meshlet *meshletData;
+  const MeshLod *lodData;
+  const char *strings;
+  const Vertex *vertexData;
+  const unsigned int *indexData;
+
+  bool validate(const std::string &sourcePath, uint32_t importOptions);
+  bool validateDependencies() const;
+
+  static uint64_t align(uint64_t offset) { return (offset + 15) & ~(uint64_t)15; }
+public:
+  MeshCache() : header(nullptr), entries(nullptr), textureRefs(nullptr), meshletData(nullptr), lodData(nullptr), strings(nullptr), vertexData(nullptr), indexData(nullptr) {}
+
+  static std::string cachePath(const std::string &sourcePath) { return sourcePath + ".meshcache"; }
+  // 导入完成后写缓存, 先写临时文件再改名, 避免读到写了一半的文件
+  // dependencies是导入时读过(或者尝试读过)的其它文件, 任何一个变化都会让缓存失效; importOptions是导入时打开的MeshCacheImportOption
+  static bool write(const std::string &sourcePath, const std::vector<MeshData> &meshes, const std::vector<std::string> &dependencies, uint32_t importOptions);
+
+  // 映射并校验sourcePath对应的缓存, 过期、损坏或者导入选项不同时返回false
+  bool open(const std::string &sourcePath, uint32_t importOptions);
+
+  unsigned int meshCount() const { return header ? header->meshCount : 0; }
+  const Vertex *vertices(unsigned int mesh) const { return vertexData + entries[mesh].firstVertex; }
+  unsigned int vertexCount(unsigned int mesh) const { return entries[mesh].vertexCount; }
+  const unsigned int *indices(unsigned int mesh) const { return indexData + entries[mesh].firstIndex; }
+  unsigned int indexCount(unsigned int mesh) const { return entries[mesh].indexCount; }
+  const Meshlet *meshlets(unsigned int mesh) const { return meshletData + entries[mesh].firstMeshlet; }
+  unsigned int meshletCount(unsigned int mesh) const { return entries[mesh].meshletCount; }
+  const MeshLod *lods(unsigned int mesh) const { return lodData + entries[mesh].firstLod; }
+  unsigned int lodCount(unsigned int mesh) const { return entries[mesh].lodCount; }
+  // 贴图只记录type和path, id需要调用方自己加载
+  std::vector<Texture> textures(unsigned int mesh) const;
+};
+
+bool MeshCache::write(const std::string &sourcePath, const std::vector<MeshData> &meshes, const std::vector<std::string> &dependencies, uint32_t importOptions)
+{
+  FileStamp stamp;
+  uint64_t sourceHash;
+  if (!statFile(sourcePath, stamp) || !hashFile(sourcePath, sourceHash))
+    return false;
+
+  std::vector<MeshCacheEntry> table;
+  std::vector<MeshCacheTextureRef> refs;
+  std::vector<Meshlet> meshlets;
+  std::vector<MeshLod> lods;
+  std::string stringData;
+  uint64_t totalVertices = 0, totalIndices = 0;
+  for (unsigned int i = 0; i < meshes.size(); i++)
+  {
+    MeshCacheEntry entry;
+    entry.firstVertex = (uint32_t)totalVertices;
+    entry.vertexCount = (uint32_t)meshes[i].vertices.size();
+    entry.firstIndex = (uint32_t)totalIndices;
+    entry.indexCount = (uint32_t)meshes[i].indices.size();
+    entry.firstTexture = (uint32_t)refs.size();
+    entry.textureCount = (uint32_t)meshes[i].textures.size();
+    entry.firstMeshlet = (uint32_t)meshlets.size();
+    entry.meshletCount = (uint32_t)meshes[i].meshlets.size();
+    meshlets.insert(meshlets.end(), meshes[i].meshlets.begin(), meshes[i].meshlets.end());
+    entry.firstLod = (uint32_t)lods.size();
+    entry.lodCount = (uint32_t)meshes[i].lods.size();
+    lods.insert(lods.end(), meshes[i].lods.begin(), meshes[i].lods.end());
+    for (unsigned int j = 0; j < meshes[i].textures.size(); j++)
+    {
+      const Texture &texture = meshes[i].textures[j];
+      MeshCacheTextureRef ref;
+      ref.typeOffset = (uint32_t)stringData.size();
+      ref.typeLength = (uint32_t)texture.type.size();
+      stringData += texture.type;
+      ref.pathOffset = (uint32_t)stringData.size();
+      ref.pathLength = (uint32_t)texture.path.size();
+      stringData += texture.path;
+      refs.push_back(ref);
+    }
+    totalVertices += entry.vertexCount;
+    totalIndices += entry.indexCount;
+    table.push_back(entry);
+  }
+  std::vector<MeshCacheDependency> files;
+  for (unsigned int i = 0; i < dependencies.size(); i++)
+  {
+    MeshCacheDependency dependency;
+    FileStamp fileStamp;
+    if (statFile(dependencies[i], fileStamp))
+    {
+      // 空文件不能映射, 哈希记为0
+      dependency.hash = 0;
+      if (fileStamp.size > 0 && !hashFile(dependencies[i], dependency.hash))
+        return false;
+      dependency.size = fileStamp.size;
+      dependency.mtime = fileStamp.mtime;
+    }
+    else
+    {
+      dependency.size = MISSING_DEPENDENCY;
+      dependency.mtime = 0;
+      dependency.hash = 0;
+    }
+    dependency.pathOffset = (uint32_t)stringData.size();
+    dependency.pathLength = (uint32_t)dependencies[i].size();
+    stringData += dependencies[i];
+    files.push_back(dependency);
+  }
+
+  MeshCacheHeader head;
+  memset(&head, 0, sizeof(head));
+  memcpy(head.magic, "MESHCACH", 8);
+  head.version = MESH_CACHE_VERSION;
+  head.vertexSize = sizeof(Vertex);
+  head.sourceSize = stamp.size;
+  head.sourceMtime = stamp.mtime;
+  head.sourceHash = sourceHash;
+  head.meshCount = (uint32_t)table.size();
+  head.textureCount = (uint32_t)refs.size();
+  head.meshletCount = (uint32_t)meshlets.size();
+  head.meshletSize = sizeof(Meshlet);
+  head.lodCount = (uint32_t)lods.size();
+  head.lodSize = sizeof(MeshLod);
+  head.dependencyCount = (uint32_t)files.size();
+  head.importOptions = importOptions;
+  head.meshTableOffset = align(sizeof(MeshCacheHeader));
+  head.textureTableOffset = align(head.meshTableOffset + table.size() * sizeof(MeshCacheEntry));
+  head.meshletOffset = align(head.textureTableOffset + refs.size() * sizeof(MeshCacheTextureRef));
+  head.lodOffset = align(head.meshletOffset + meshlets.size() * sizeof(Meshlet));
+  head.dependencyOffset = align(head.lodOffset + lods.size() * sizeof(MeshLod));
+  head.stringOffset = align(head.dependencyOffset + files.size() * sizeof(MeshCacheDependency));
+  head.vertexOffset = align(head.stringOffset + stringData.size());
+  head.indexOffset = align(head.vertexOffset + totalVertices * sizeof(Vertex));
+  head.fileSize = head.indexOffset + totalIndices * sizeof(unsigned int);
+
+  std::vector<unsigned char> buffer((size_t)head.fileSize, 0);
+  memcpy(&buffer[0], &head, sizeof(head));
+  if (!table.empty())
+    memcpy(&buffer[head.meshTableOffset], &table[0], table.size() * sizeof(MeshCacheEntry));
+  if (!refs.empty())
+    memcpy(&buffer[head.textureTableOffset], &refs[0], refs.size() * sizeof(MeshCacheTextureRef));
+  if (!meshlets.empty())
+    memcpy(&buffer[head.meshletOffset], &meshlets[0], meshlets.size() * sizeof(Meshlet));
+  if (!lods.empty())
+    memcpy(&buffer[head.lodOffset], &lods[0], lods.size() * sizeof(MeshLod));
+  if (!files.empty())
+    memcpy(&buffer[head.dependencyOffset], &files[0], files.size() * sizeof(MeshCacheDependency));
+  if (!stringData.empty())
+    memcpy(&buffer[head.stringOffset], stringData.data(), stringData.size());
+  for (unsigned int i = 0; i < meshes.size(); i++)
+  {
+    if (!meshes[i].vertices.empty())
+      memcpy(&buffer[head.vertexOffset + (uint64_t)table[i].firstVertex * sizeof(Vertex)], &meshes[i].vertices[0], meshes[i].vertices.size() * sizeof(Vertex));
+    if (!meshes[i].indices.empty())
+      memcpy(&buffer[head.indexOffset + (uint64_t)table[i].firstIndex * sizeof(unsigned int)], &meshes[i].indices[0], meshes[i].indices.size() * sizeof(unsigned int));
+  }
+
+  std::string path = cachePath(sourcePath);
+  std::string tmpPath = path + ".tmp";
+  FILE *out = fopen(tmpPath.c_str(), "wb");
+  if (!out)
+    return false;
+  bool ok = fwrite(&buffer[0], 1, buffer.size(), out) == buffer.size();
+  ok = fclose(out) == 0 && ok;
+  if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0)
+  {
+    remove(tmpPath.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool MeshCache::open(const std::string &sourcePath, uint32_t importOptions)
+{
+  header = nullptr;
+  if (!file.open(cachePath(sourcePath)))
+    return false;
+  if (!validate(sourcePath, importOptions))
+  {
+    header = nullptr;
+    file.close();
+    return false;
+  }
+  const unsigned char *base = file.data();
+  entries = (const MeshCacheEntry *)(base + header->meshTableOffset);
+  textureRefs = (const MeshCacheTextureRef *)(base + header->textureTableOffset);
+  meshletData = (const Meshlet *)(base + header->meshletOffset);
+  lodData = (const MeshLod *)(base + header->lodOffset);
+  strings = (const char *)(base + header->stringOffset);
+  vertexData = (const Vertex *)(base + header->vertexOffset);
+  indexData = (const unsigned int *)(base + header->indexOffset);
+  return true;
+}
+
+bool MeshCache::validate(const std::string &sourcePath, uint32_t importOptions)
+{
+  if (file.size() < sizeof(MeshCacheHeader))
+    return false;
+  header = (const MeshCacheHeader *)file.data();
+  if (memcmp(header->magic, "MESHCACH", 8) != 0 || header->version != MESH_CACHE_VERSION || header->vertexSize != sizeof(Vertex) ||
+      header->meshletSize != sizeof(Meshlet) || header->lodSize != sizeof(MeshLod) || header->importOptions != importOptions)
+    return false;
+  // 各区域依次排列, 字符串区夹在依赖表和顶点数组之间
+  if (header->fileSize != file.size() || header->stringOffset > header->vertexOffset || header->vertexOffset > header->indexOffset ||
+      header->indexOffset > header->fileSize)
+    return false;
+  if (header->meshTableOffset + (uint64_t)header->meshCount * sizeof(MeshCacheEntry) > header->stringOffset ||
+      header->textureTableOffset + (uint64_t)header->textureCount * sizeof(MeshCacheTextureRef) > header->stringOffset ||
+      header->meshletOffset + (uint64_t)header->meshletCount * sizeof(Meshlet) > header->stringOffset ||
+      header->lodOffset + (uint64_t)header->lodCount * sizeof(MeshLod) > header->stringOffset ||
+      header->dependencyOffset + (uint64_t)header->dependencyCount * sizeof(MeshCacheDependency) > header->stringOffset)
+    return false;
+  uint64_t stringSize = header->vertexOffset - header->stringOffset;
+
+  // 大小和修改时间都没变就认为缓存有效; 时间变了(比如重新checkout)再比较内容哈希
+  FileStamp stamp;
+  if (!statFile(sourcePath, stamp) || stamp.size != header->sourceSize)
+    return false;
+  if (stamp.mtime != header->sourceMtime)
+  {
+    uint64_t sourceHash;
+    if (!hashFile(sourcePath, sourceHash) || sourceHash != header->sourceHash)
+      return false;
+  }
+  const MeshCacheDependency *files = (const MeshCacheDependency *)(file.data() + header->dependencyOffset);
+  for (unsigned int i = 0; i < header->dependencyCount; i++)
+    if ((uint64_t)files[i].pathOffset + files[i].pathLength > stringSize)
+      return false;
+  if (!validateDependencies())
+    return false;
+
+  // 检查每个网格的范围没有越界
+  const MeshCacheEntry *table = (const MeshCacheEntry *)(file.data() + header->meshTableOffset);
+  uint64_t vertexTotal = (header->indexOffset - header->vertexOffset) / sizeof(Vertex);
+  uint64_t indexTotal = (header->fileSize - header->indexOffset) / sizeof(unsigned int);
+  const MeshCacheTextureRef *refs = (const MeshCacheTextureRef *)(file.data() + header->textureTableOffset);
+  for (unsigned int i = 0; i < header->textureCount; i++)
+    if ((uint64_t)refs[i].typeOffset + refs[i].typeLength > stringSize || (uint64_t)refs[i].pathOffset + refs[i].pathLength > stringSize)
+      return false;
+  for (unsigned int i = 0; i < header->meshCount; i++)
+  {
+    if ((uint64_t)table[i].firstVertex + table[i].vertexCount > vertexTotal ||
+        (uint64_t)table[i].firstIndex + table[i].indexCount > indexTotal ||
+        (uint64_t)table[i].firstTexture + table[i].textureCount > header->textureCount ||
+        (uint64_t)table[i].firstMeshlet + table[i].meshletCount > header->meshletCount ||
+        (uint64_t)table[i].firstLod + table[i].lodCount > header->lodCount)
+      return false;
+    const MeshLod *levels = (const MeshLod *)(file.data() + header->lodOffset) + table[i].firstLod;
+    for (unsigned int j = 0; j < table[i].lodCount; j++)
+      if ((uint64_t)levels[j].firstIndex + levels[j].indexCount > table[i].indexCount)
+        return false;
+    const Meshlet *clusters = (const Meshlet *)(file.data() + header->meshletOffset) + table[i].firstMeshlet;
+    for (unsigned int j = 0; j < table[i].meshletCount; j++)
+      if ((uint64_t)clusters[j].firstIndex + clusters[j].indexCount > table[i].indexCount)
+        return false;
+    // 索引会直接交给glDrawElementsBaseVertex, 不足65536个顶点时还会截成16位, 越界的值必须在这里拒绝
+    const unsigned int *meshIndices = (const unsigned int *)(file.data() + header->indexOffset) + table[i].firstIndex;
+    for (unsigned int j = 0; j < table[i].indexCount; j++)
+      if (meshIndices[j] >= table[i].vertexCount)
+        return false;
+  }
+  return true;
+}
+
+bool MeshCache::validateDependencies() const
+{
+  const MeshCacheDependency *files = (const MeshCacheDependency *)(file.data() + header->dependencyOffset);
+  const char *names = (const char *)(file.data() + header->stringOffset);
+  for (unsigned int i = 0; i < header->dependencyCount; i++)
+  {
+    std::string path(names + files[i].pathOffset, files[i].pathLength);
+    FileStamp stamp;
+    bool exists = statFile(path, stamp);
+    if (files[i].size == MISSING_DEPENDENCY)
+    {
+      if (exists)
+        return false;
+      continue;
+    }
+    if (!exists || stamp.size != files[i].size)
+      return false;
+    uint64_t hash;
+    if (stamp.mtime != files[i].mtime && stamp.size > 0 && (!hashFile(path, hash) || hash != files[i].hash))
+      return false;
+  }
+  return true;
+}
+
+std::vector<Texture> MeshCache::textures(unsigned int mesh) const
+{
+  std::vector<Texture> result;
+  for (unsigned int i = 0; i < entries[mesh].textureCount; i++)
+  {
+    const MeshCacheTextureRef &ref = textureRefs[entries[mesh].firstTexture + i];
+    Texture texture;
+    texture.id = 0;
+    texture.type = std::string(strings + ref.typeOffset, ref.typeLength);
+    texture.path = std::string(strings + ref.pathOffset, ref.pathLength);
+    result.push_back(texture);
+  }
+  return result;
+}
+
+#endif
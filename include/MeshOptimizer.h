@@ -0,0 +1,255 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+
+#include <glm/glm.hpp>
+
+#include <Mesh.h>
+
+// 顶点后变换缓存的统计, 用FIFO缓存模拟
+// ACMR: 每个三角形平均需要处理的顶点数, 0.5~3, 越小越好
+// ATVR: 处理的顶点数 / 实际顶点数, 最好是1
+struct VertexCacheStats
+{
+  float acmr;
+  float atvr;
+};
+
+// 导入阶段的网格优化, 只处理CPU数据, 可以在工作线程里调用:
+// 1. 用Tipsify重排三角形, 提高顶点后变换缓存的命中率
+// 2. 按Tipsify的断点把三角形分簇, 朝外的簇先画, 减少overdraw
+// 3. 按第一次被引用的顺序重排顶点, 提高顶点读取的局部性
+class MeshOptimizer
+{
+private:
+  static void tipsify(std::vector<unsigned int> &indices, unsigned int vertexCount, unsigned int cacheSize, std::vector<unsigned int> &clusters);
+  static void sortClusters(std::vector<unsigned int> &indices, const std::vector<Vertex> &vertices, const std::vector<unsigned int> &clusters);
+  static void reorderVertices(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices);
+public:
+  // 模拟的缓存大小, 和大多数GPU的有效后变换缓存差不多
+  static const unsigned int CACHE_SIZE = 16;
+
+  static VertexCacheStats analyze(const std::vector<unsigned int> &indices, unsigned int vertexCount, unsigned int cacheSize = CACHE_SIZE);
+  // 依次做三步优化, 不是纯三角形列表的网格保持不变, 返回是否优化过
+  static bool optimize(MeshData &mesh);
+  // 只重排三角形, 不动顶点; 用于和LOD0共用顶点的简化层级
+  static void optimizeTriangles(std::vector<unsigned int> &indices, unsigned int vertexCount);
+};
+
+VertexCacheStats MeshOptimizer::analyze(const std::vector<unsigned int> &indices, unsigned int vertexCount, unsigned int cacheSize)
+{
+  // 不到一个三角形时没有可以统计的东西, 下面的除法也会除以0
+  VertexCacheStats stats = { 0.0f, 0.0f };
+  if (indices.size() < 3 || vertexCount == 0)
+    return stats;
+  // 每个顶点记录进入缓存时的时间戳, 时间戳落后超过cacheSize说明已经被挤出FIFO
+  std::vector<unsigned int> timestamps(vertexCount, 0);
+  std::vector<bool> used(vertexCount, false);
+  unsigned int time = cacheSize + 1;
+  unsigned int misses = 0, unique = 0;
+  for (unsigned int i = 0; i < indices.size(); i++)
+  {
+    unsigned int v = indices[i];
+    if (time - timestamps[v] > cacheSize)
+    {
+      timestamps[v] = time++;
+      misses++;
+    }
+    if (!used[v])
+    {
+      used[v] = true;
+      unique++;
+    }
+  }
+  stats.acmr = (float)misses / (indices.size() / 3);
+  stats.atvr = (float)misses / unique;
+  return stats;
+}
+
+void MeshOptimizer::tipsify(std::vector<unsigned int> &indices, unsigned int vertexCount, unsigned int cacheSize, std::vector<unsigned int> &clusters)
+{
+  unsigned int triangleCount = (unsigned int)indices.size() / 3;
+
+  // 顶点 -> 相邻三角形, 用CSR格式存放
+  std::vector<unsigned int> live(vertexCount, 0);
+  for (unsigned int i = 0; i < indices.size(); i++)
+    live[indices[i]]++;
+  std::vector<unsigned int> offsets(vertexCount + 1, 0);
+  for (unsigned int v = 0; v < vertexCount; v++)
+    offsets[v + 1] = offsets[v] + live[v];
+  std::vector<unsigned int> adjacency(indices.size());
+  std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+  for (unsigned int i = 0; i < indices.size(); i++)
+    adjacency[fill[indices[i]]++] = i / 3;
+
+  std::vector<unsigned int> timestamps(vertexCount, 0);
+  std::vector<bool> emitted(triangleCount, false);
+  std::vector<unsigned int> deadEnd;
+  std::vector<unsigned int> candidates;
+  std::vector<unsigned int> output;
+  output.reserve(indices.size());
+  unsigned int time = cacheSize + 1;
+  unsigned int cursor = 0;
+  int fanning = 0;
+
+  clusters.clear();
+  clusters.push_back(0);
+  while (fanning >= 0)
+  {
+    // 输出fanning顶点周围所有还没输出的三角形
+    candidates.clear();
+    for (unsigned int a = offsets[fanning]; a < offsets[fanning + 1]; a++)
+    {
+      unsigned int t = adjacency[a];
+      if (emitted[t])
+        continue;
+      emitted[t] = true;
+      for (unsigned int k = 0; k < 3; k++)
+      {
+        unsigned int v = indices[t * 3 + k];
+        output.push_back(v);
+        deadEnd.push_back(v);
+        candidates.push_back(v);
+        live[v]--;
+        if (time - timestamps[v] > cacheSize)
+          timestamps[v] = time++;
+      }
+    }
+
+    // 下一个fanning顶点: 在缓存里、输出它的三角形之后还不会被挤出去的顶点中选最老的
+    int next = -1, best = -1;
+    for (unsigned int c = 0; c < candidates.size(); c++)
+    {
+      unsigned int v = candidates[c];
+      if (live[v] == 0)
+        continue;
+      int priority = 0;
+      if (time - timestamps[v] + 2 * live[v] <= cacheSize)
+        priority = (int)(time - timestamps[v]);
+      if (priority > best)
+      {
+        best = priority;
+        next = (int)v;
+      }
+    }
+    if (next < 0)
+    {
+      // 走到死胡同, 先从最近输出的顶点里找, 再按顺序扫描; 这里是缓存断开的地方, 作为簇的边界
+      while (!deadEnd.empty() && next < 0)
+      {
+        unsigned int v = deadEnd.back();
+        deadEnd.pop_back();
+        if (live[v] > 0)
+          next = (int)v;
+      }
+      while (next < 0 && cursor < vertexCount)
+      {
+        if (live[cursor] > 0)
+          next = (int)cursor;
+        cursor++;
+      }
+      if (next >= 0 && output.size() / 3 > clusters.back())
+        clusters.push_back((unsigned int)output.size() / 3);
+    }
+    fanning = next;
+  }
+  indices.swap(output);
+}
+
+void MeshOptimizer::sortClusters(std::vector<unsigned int> &indices, const std::vector<Vertex> &vertices, const std::vector<unsigned int> &clusters)
+{
+  unsigned int triangleCount = (unsigned int)indices.size() / 3;
+  if (clusters.size() < 2)
+    return;
+
+  // 簇的中心和面积加权法线; 中心越靠外、法线越朝外的簇越先画, 后面画的被挡住的像素会被深度测试提前剔除
+  glm::vec3 meshCenter(0.0f);
+  float meshArea = 0.0f;
+  std::vector<glm::vec3> centers(clusters.size(), glm::vec3(0.0f));
+  std::vector<glm::vec3> normals(clusters.size(), glm::vec3(0.0f));
+  std::vector<float> areas(clusters.size(), 0.0f);
+  for (unsigned int c = 0; c < clusters.size(); c++)
+  {
+    unsigned int end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+    for (unsigned int t = clusters[c]; t < end; t++)
+    {
+      const glm::vec3 &p0 = vertices[indices[t * 3]].Position;
+      const glm::vec3 &p1 = vertices[indices[t * 3 + 1]].Position;
+      const glm::vec3 &p2 = vertices[indices[t * 3 + 2]].Position;
+      glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+      float area = glm::length(normal);
+      centers[c] += (p0 + p1 + p2) * (area / 3.0f);
+      normals[c] += normal;
+      areas[c] += area;
+    }
+    meshCenter += centers[c];
+    meshArea += areas[c];
+    if (areas[c] > 0.0f)
+      centers[c] /= areas[c];
+  }
+  if (meshArea > 0.0f)
+    meshCenter /= meshArea;
+
+  std::vector<float> keys(clusters.size());
+  std::vector<unsigned int> order(clusters.size());
+  for (unsigned int c = 0; c < clusters.size(); c++)
+  {
+    keys[c] = glm::dot(centers[c] - meshCenter, normals[c]);
+    order[c] = c;
+  }
+  std::stable_sort(order.begin(), order.end(), [&keys](unsigned int a, unsigned int b) { return keys[a] > keys[b]; });
+
+  std::vector<unsigned int> sorted;
+  sorted.reserve(indices.size());
+  for (unsigned int i = 0; i < order.size(); i++)
+  {
+    unsigned int c = order[i];
+    unsigned int end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+    sorted.insert(sorted.end(), indices.begin() + clusters[c] * 3, indices.begin() + end * 3);
+  }
+  indices.swap(sorted);
+}
+
+void MeshOptimizer::reorderVertices(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices)
+{
+  // 按索引里第一次出现的顺序重新编号, 没有被引用的顶点直接丢掉
+  const unsigned int unassigned = 0xffffffffu;
+  std::vector<unsigned int> remap(vertices.size(), unassigned);
+  std::vector<Vertex> reordered;
+  reordered.reserve(vertices.size());
+  for (unsigned int i = 0; i < indices.size(); i++)
+  {
+    unsigned int &slot = remap[indices[i]];
+    if (slot == unassigned)
+    {
+      slot = (unsigned int)reordered.size();
+      reordered.push_back(vertices[indices[i]]);
+    }
+    indices[i] = slot;
+  }
+  vertices.swap(reordered);
+}
+
+bool MeshOptimizer::optimize(MeshData &mesh)
+{
+  if (mesh.indices.empty() || mesh.indices.size() % 3 != 0)
+    return false;
+  std::vector<unsigned int> clusters;
+  tipsify(mesh.indices, (unsigned int)mesh.vertices.size(), CACHE_SIZE, clusters);
+  sortClusters(mesh.indices, mesh.vertices, clusters);
+  reorderVertices(mesh.vertices, mesh.indices);
+  return true;
+}
+
+void MeshOptimizer::optimizeTriangles(std::vector<unsigned int> &indices, unsigned int vertexCount)
+{
+  if (indices.empty() || indices.size() % 3 != 0)
+    return;
+  std::vector<unsigned int> clusters;
+  tipsify(indices, vertexCount, CACHE_SIZE, clusters);
+}
+
+#endif
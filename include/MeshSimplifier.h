@@ -0,0 +1,249 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <stdint.h>
+
+#include <glm/glm.hpp>
+
+#include <Mesh.h>
+#include <MeshOptimizer.h>
+
+// 导入阶段的网格简化, 用二次误差度量(QEM)做半边折叠: 顶点u合并到相邻顶点v, 不产生新顶点,
+// 所以各级LOD只是索引不同, 和LOD0共用同一份顶点
+// 只在一个三角形里出现的边是开放边, 包括索引意义上的UV/法线接缝(同一位置拆成了多个顶点),
+// 开放边上的顶点不会被折叠掉, 接缝和网格边界因此保持原样
+class MeshSimplifier
+{
+private:
+  // 对称4x4矩阵的上三角和累计的面积权重
+  struct Quadric
+  {
+    double a[10];
+    double weight;
+  };
+
+  struct Collapse
+  {
+    float cost;
+    unsigned int from;
+    unsigned int to;
+  };
+
+  static void addPlane(Quadric &q, const glm::vec3 &normal, float distance, float weight);
+  static void addQuadric(Quadric &q, const Quadric &other);
+  // 到所有平面的面积加权平均平方距离
+  static float evaluate(const Quadric &q, const glm::vec3 &p);
+  static bool flips(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, const std::vector<unsigned int> &offsets,
+                    const std::vector<unsigned int> &adjacency, unsigned int from, unsigned int to);
+public:
+  // 包括LOD0最多几级, 每级的目标三角形数是上一级的一半
+  static const unsigned int LOD_COUNT = 4;
+
+  // 把indices简化到不超过targetIndexCount个索引(简化不动时会多一些), 返回模型空间里的几何误差
+  static float simplify(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, unsigned int targetIndexCount, std::vector<unsigned int> &result);
+  // 生成100/50/25/12.5%的LOD链, 追加到mesh.indices后面; 简化不下去时提前结束
+  static void buildLods(MeshData &mesh);
+};
+
+void MeshSimplifier::addPlane(Quadric &q, const glm::vec3 &normal, float distance, float weight)
+{
+  double n[4] = { normal.x, normal.y, normal.z, distance };
+  int k = 0;
+  for (int i = 0; i < 4; i++)
+    for (int j = i; j < 4; j++)
+      q.a[k++] += n[i] * n[j] * weight;
+  q.weight += weight;
+}
+
+void MeshSimplifier::addQuadric(Quadric &q, const Quadric &other)
+{
+  for (int i = 0; i < 10; i++)
+    q.a[i] += other.a[i];
+  q.weight += other.weight;
+}
+
+float MeshSimplifier::evaluate(const Quadric &q, const glm::vec3 &p)
+{
+  double x = p.x, y = p.y, z = p.z;
+  double error = q.a[0] * x * x + 2.0 * q.a[1] * x * y + 2.0 * q.a[2] * x * z + 2.0 * q.a[3] * x
+               + q.a[4] * y * y + 2.0 * q.a[5] * y * z + 2.0 * q.a[6] * y
+               + q.a[7] * z * z + 2.0 * q.a[8] * z
+               + q.a[9];
+  return q.weight > 0.0 ? (float)std::fabs(error / q.weight) : 0.0f;
+}
+
+bool MeshSimplifier::flips(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, const std::vector<unsigned int> &offsets,
+                           const std::vector<unsigned int> &adjacency, unsigned int from, unsigned int to)
+{
+  // 折叠后会退化掉的三角形(同时含from和to)不检查, 其余三角形的法线不能翻转
+  for (unsigned int a = offsets[from]; a < offsets[from + 1]; a++)
+  {
+    const unsigned int *tri = &indices[adjacency[a] * 3];
+    if (tri[0] == to || tri[1] == to || tri[2] == to)
+      continue;
+    glm::vec3 before[3], after[3];
+    for (int k = 0; k < 3; k++)
+    {
+      before[k] = vertices[tri[k]].Position;
+      after[k] = tri[k] == from ? vertices[to].Position : before[k];
+    }
+    glm::vec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+    glm::vec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+    if (glm::dot(n0, n1) <= 0.0f)
+      return true;
+  }
+  return false;
+}
+
+float MeshSimplifier::simplify(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, unsigned int targetIndexCount, std::vector<unsigned int> &result)
+{
+  result = indices;
+  unsigned int vertexCount = (unsigned int)vertices.size();
+  if (result.size() % 3 != 0 || result.size() <= targetIndexCount)
+    return 0.0f;
+
+  // 每个顶点的二次误差: 相邻三角形所在平面, 按面积加权
+  Quadric zero;
+  std::fill(zero.a, zero.a + 10, 0.0);
+  zero.weight = 0.0;
+  std::vector<Quadric> quadrics(vertexCount, zero);
+  for (unsigned int t = 0; t < result.size(); t += 3)
+  {
+    const glm::vec3 &p0 = vertices[result[t]].Position;
+    const glm::vec3 &p1 = vertices[result[t + 1]].Position;
+    const glm::vec3 &p2 = vertices[result[t + 2]].Position;
+    glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+    float area = glm::length(normal);
+    if (area <= 0.0f)
+      continue;
+    normal /= area;
+    for (int k = 0; k < 3; k++)
+      addPlane(quadrics[result[t + k]], normal, -glm::dot(normal, p0), area);
+  }
+
+  // 开放边上的顶点锁定
+  std::unordered_map<uint64_t, unsigned int> edges;
+  for (unsigned int t = 0; t < result.size(); t += 3)
+    for (int k = 0; k < 3; k++)
+    {
+      unsigned int a = result[t + k], b = result[t + (k + 1) % 3];
+      edges[a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a]++;
+    }
+  std::vector<bool> locked(vertexCount, false);
+  for (std::unordered_map<uint64_t, unsigned int>::const_iterator it = edges.begin(); it != edges.end(); ++it)
+    if (it->second != 2)
+    {
+      locked[(unsigned int)(it->first >> 32)] = true;
+      locked[(unsigned int)(it->first & 0xffffffffu)] = true;
+    }
+
+  // 分多轮折叠: 每轮按代价从小到大执行互不影响的折叠, 然后重写索引、删掉退化的三角形
+  float maxError = 0.0f;
+  std::vector<unsigned int> offsets, adjacency, remap(vertexCount);
+  std::vector<bool> touched;
+  std::vector<Collapse> collapses;
+  while (result.size() > targetIndexCount)
+  {
+    offsets.assign(vertexCount + 1, 0);
+    for (unsigned int i = 0; i < result.size(); i++)
+      offsets[result[i] + 1]++;
+    for (unsigned int v = 0; v < vertexCount; v++)
+      offsets[v + 1] += offsets[v];
+    adjacency.resize(result.size());
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for (unsigned int i = 0; i < result.size(); i++)
+      adjacency[fill[result[i]]++] = i / 3;
+
+    collapses.clear();
+    for (unsigned int t = 0; t < result.size(); t += 3)
+      for (int k = 0; k < 3; k++)
+      {
+        unsigned int a = result[t + k], b = result[t + (k + 1) % 3];
+        for (int direction = 0; direction < 2; direction++)
+        {
+          unsigned int from = direction ? b : a, to = direction ? a : b;
+          if (locked[from])
+            continue;
+          Quadric merged = quadrics[from];
+          addQuadric(merged, quadrics[to]);
+          Collapse collapse = { evaluate(merged, vertices[to].Position), from, to };
+          collapses.push_back(collapse);
+        }
+      }
+    std::sort(collapses.begin(), collapses.end(), [](const Collapse &a, const Collapse &b) { return a.cost < b.cost; });
+
+    for (unsigned int v = 0; v < vertexCount; v++)
+      remap[v] = v;
+    touched.assign(vertexCount, false);
+    size_t triangles = result.size() / 3, target = targetIndexCount / 3;
+    unsigned int applied = 0;
+    for (unsigned int c = 0; c < collapses.size() && triangles > target; c++)
+    {
+      const Collapse &collapse = collapses[c];
+      if (touched[collapse.from] || touched[collapse.to])
+        continue;
+      if (flips(vertices, result, offsets, adjacency, collapse.from, collapse.to))
+        continue;
+      // from周围的三角形这一轮都会改变, 它们的顶点这一轮不再参与折叠
+      for (unsigned int a = offsets[collapse.from]; a < offsets[collapse.from + 1]; a++)
+      {
+        const unsigned int *tri = &result[adjacency[a] * 3];
+        if (tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to)
+          triangles--;
+        for (int k = 0; k < 3; k++)
+          touched[tri[k]] = true;
+      }
+      remap[collapse.from] = collapse.to;
+      addQuadric(quadrics[collapse.to], quadrics[collapse.from]);
+      maxError = std::max(maxError, collapse.cost);
+      applied++;
+    }
+    if (applied == 0)
+      break;
+
+    unsigned int write = 0;
+    for (unsigned int t = 0; t < result.size(); t += 3)
+    {
+      unsigned int a = remap[result[t]], b = remap[result[t + 1]], c = remap[result[t + 2]];
+      if (a == b || b == c || a == c)
+        continue;
+      result[write++] = a;
+      result[write++] = b;
+      result[write++] = c;
+    }
+    result.resize(write);
+  }
+  return std::sqrt(maxError);
+}
+
+void MeshSimplifier::buildLods(MeshData &mesh)
+{
+  mesh.lods.clear();
+  if (mesh.indices.empty() || mesh.indices.size() % 3 != 0)
+    return;
+  MeshLod base = { 0, (uint32_t)mesh.indices.size(), 0.0f };
+  mesh.lods.push_back(base);
+
+  // 每级从上一级继续简化, 误差取累计的最大值
+  std::vector<unsigned int> previous(mesh.indices), simplified;
+  float error = 0.0f;
+  for (unsigned int level = 1; level < LOD_COUNT; level++)
+  {
+    unsigned int target = (unsigned int)(mesh.lods[0].indexCount >> level) / 3 * 3;
+    error = std::max(error, simplify(mesh.vertices, previous, target, simplified));
+    // 减少不到10%的层级没有意义, 说明剩下的大多是锁定的顶点
+    if (simplified.empty() || simplified.size() * 10 > previous.size() * 9)
+      break;
+    MeshOptimizer::optimizeTriangles(simplified, (unsigned int)mesh.vertices.size());
+    MeshLod lod = { (uint32_t)mesh.indices.size(), (uint32_t)simplified.size(), error };
+    mesh.indices.insert(mesh.indices.end(), simplified.begin(), simplified.end());
+    mesh.lods.push_back(lod);
+    previous.swap(simplified);
+  }
+}
+
+#endif
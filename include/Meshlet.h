@@ -0,0 +1,189 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <stdint.h>
+
+#include <glm/glm.hpp>
+
+#include <VertexFormat.h>
+
+// 网格簇: 网格索引缓冲里一段连续的三角形(最多64个顶点、124个三角形), 在模型空间里记录:
+// 包围球, 用来做视锥剔除; 法线锥, 簇里所有三角形都背对相机时整簇剔除
+// 结构是POD, 直接写进网格缓存
+struct Meshlet
+{
+  glm::vec3 center;
+  float radius;
+  glm::vec3 coneAxis;
+  float coneCutoff; // 法线锥半角的正弦, 大于1表示锥太宽, 不能做背面剔除
+  uint32_t firstIndex;
+  uint32_t indexCount;
+
+  // eye是模型空间里的相机位置; 只适用于单面绘制的封闭网格
+  bool backfacing(const glm::vec3 &eye) const
+  {
+    glm::vec3 direction = center - eye;
+    float distance = glm::length(direction);
+    return glm::dot(direction, coneAxis) >= coneCutoff * distance + radius;
+  }
+};
+
+// 导入阶段把优化后的三角形顺序切成簇, 不改动索引, 每个簇就是索引里的一段
+// 顶点缓存优化之后相邻的三角形在空间上也相邻, 顺序切分得到的簇足够紧凑
+class MeshletBuilder
+{
+private:
+  static Meshlet finish(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, unsigned int firstTriangle, unsigned int endTriangle);
+public:
+  static const unsigned int MAX_VERTICES = 64;
+  static const unsigned int MAX_TRIANGLES = 124;
+
+  static void build(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, std::vector<Meshlet> &meshlets);
+};
+
+void MeshletBuilder::build(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, std::vector<Meshlet> &meshlets)
+{
+  meshlets.clear();
+  unsigned int triangleCount = (unsigned int)indices.size() / 3;
+  if (triangleCount == 0 || indices.size() % 3 != 0)
+    return;
+
+  // 每个顶点记下最后加入的簇的编号, 用来统计当前簇里不同顶点的个数
+  std::vector<unsigned int> owner(vertices.size(), 0xffffffffu);
+  unsigned int current = 0, vertexCount = 0, first = 0;
+  for (unsigned int t = 0; t < triangleCount; t++)
+  {
+    unsigned int added = 0;
+    for (unsigned int k = 0; k < 3; k++)
+      added += owner[indices[t * 3 + k]] != current ? 1 : 0;
+    if (vertexCount + added > MAX_VERTICES || t - first >= MAX_TRIANGLES)
+    {
+      meshlets.push_back(finish(vertices, indices, first, t));
+      current++;
+      vertexCount = 0;
+      first = t;
+    }
+    for (unsigned int k = 0; k < 3; k++)
+    {
+      unsigned int &v = owner[indices[t * 3 + k]];
+      if (v != current)
+      {
+        v = current;
+        vertexCount++;
+      }
+    }
+  }
+  meshlets.push_back(finish(vertices, indices, first, triangleCount));
+}
+
+Meshlet MeshletBuilder::finish(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, unsigned int firstTriangle, unsigned int endTriangle)
+{
+  Meshlet meshlet;
+  meshlet.firstIndex = firstTriangle * 3;
+  meshlet.indexCount = (endTriangle - firstTriangle) * 3;
+
+  // 包围球: 包围盒中心到最远顶点的距离
+  glm::vec3 minimum = vertices[indices[meshlet.firstIndex]].Position, maximum = minimum;
+  for (unsigned int i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i++)
+  {
+    minimum = glm::min(minimum, vertices[indices[i]].Position);
+    maximum = glm::max(maximum, vertices[indices[i]].Position);
+  }
+  meshlet.center = (minimum + maximum) * 0.5f;
+  meshlet.radius = 0.0f;
+  for (unsigned int i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i++)
+    meshlet.radius = glm::max(meshlet.radius, glm::length(vertices[indices[i]].Position - meshlet.center));
+
+  // 法线锥: 轴是三角形法线的平均方向, 半角由和轴夹角最大的法线决定
+  std::vector<glm::vec3> normals;
+  glm::vec3 axis(0.0f);
+  for (unsigned int t = firstTriangle; t < endTriangle; t++)
+  {
+    const glm::vec3 &p0 = vertices[indices[t * 3]].Position;
+    const glm::vec3 &p1 = vertices[indices[t * 3 + 1]].Position;
+    const glm::vec3 &p2 = vertices[indices[t * 3 + 2]].Position;
+    glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+    float length = glm::length(normal);
+    if (length <= 0.0f)
+      continue;
+    normals.push_back(normal / length);
+    axis += normals.back();
+  }
+  float axisLength = glm::length(axis);
+  meshlet.coneAxis = axisLength > 0.0f ? axis / axisLength : glm::vec3(0.0f, 0.0f, 1.0f);
+  float minDot = axisLength > 0.0f ? 1.0f : -1.0f;
+  for (unsigned int i = 0; i < normals.size(); i++)
+    minDot = glm::min(minDot, glm::dot(normals[i], meshlet.coneAxis));
+  // 半角超过90度时任何方向都能看到某个三角形的正面
+  meshlet.coneCutoff = minDot > 0.0f ? std::sqrt(1.0f - minDot * minDot) : 2.0f;
+  return meshlet;
+}
+
+// 从裁剪矩阵提取的6个平面(Gribb-Hartmann), 用模型的MVP提取时平面就在模型空间里
+struct Frustum
+{
+  glm::vec4 planes[6];
+
+  explicit Frustum(const glm::mat4 &m)
+  {
+    // glm是列主序, m[c][r]是第r行第c列
+    for (int i = 0; i < 3; i++)
+    {
+      planes[i * 2] = glm::vec4(m[0][3] + m[0][i], m[1][3] + m[1][i], m[2][3] + m[2][i], m[3][3] + m[3][i]);
+      planes[i * 2 + 1] = glm::vec4(m[0][3] - m[0][i], m[1][3] - m[1][i], m[2][3] - m[2][i], m[3][3] - m[3][i]);
+    }
+    for (int i = 0; i < 6; i++)
+      planes[i] /= glm::length(glm::vec3(planes[i]));
+  }
+
+  bool intersects(const glm::vec3 &center, float radius) const
+  {
+    for (int i = 0; i < 6; i++)
+      if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius)
+        return false;
+    return true;
+  }
+};
+
+// 每帧的簇剔除统计, 在帧末调用endFrame
+struct MeshletStats
+{
+  unsigned int meshlets;
+  unsigned int frustumCulled;
+  unsigned int coneCulled;
+  unsigned int draws;
+  unsigned long long triangles;
+  unsigned long long submitted;
+
+  static MeshletStats &current()
+  {
+    static MeshletStats stats = { 0, 0, 0, 0, 0, 0 };
+    return stats;
+  }
+
+  static MeshletStats endFrame()
+  {
+    MeshletStats &stats = current();
+    MeshletStats last = stats;
+    stats = MeshletStats();
+    return last;
+  }
+
+  void print() const
+  {
+    if (meshlets == 0)
+      return;
+    std::ostringstream line;
+    line << std::fixed << std::setprecision(1) << "MESHLETS:: " << submitted << " / " << triangles << " triangles submitted ("
+         << (triangles ? 100.0 * submitted / triangles : 0.0) << "%), " << meshlets << " meshlets, " << frustumCulled << " frustum culled, "
+         << coneCulled << " backface culled, " << draws << " draws";
+    std::cout << line.str() << std::endl;
+  }
+};
+
+#endif
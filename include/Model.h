@@ -2,76 +2,286 @@
 #define MODEL_H
 
 #include <vector>
+#include <algorithm>
+#include <utility>
 #include <string>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <unordered_map>
 
 #include <assimp/Importer.hpp>
+#include <assimp/DefaultIOSystem.h>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include <glm/glm.hpp>
 #include <stb_image.h>
 
+#include <Diagnostics.h>
 #include <Mesh.h>
+#include <MeshCache.h>
+#include <MeshOptimizer.h>
+#include <MeshSimplifier.h>
+#include <TangentSpace.h>
+#include <ObjLoader.h>
 #include <Shader.h>
+#include <TextureCache.h>
+#include <ThreadPool.h>
 
 
-unsigned int TextureFromFile(char const * path, const std::string &directory, bool gamma = false);
+unsigned int TextureFromFile(char const * path, const std::string &directory, bool gamma = false, TextureUsage usage = TEXTURE_AUTO);
+
+// 记下Assimp导入时打开过的文件(材质库、外部缓冲区等), 写进网格缓存的依赖表
+class RecordingIOSystem : public Assimp::DefaultIOSystem
+{
+private:
+  std::string source;
+  std::vector<std::string> &opened;
+public:
+  RecordingIOSystem(const std::string &sourcePath, std::vector<std::string> &files) : source(sourcePath), opened(files) {}
+
+  Assimp::IOStream *Open(const char *file, const char *mode = "rb") override
+  {
+    Assimp::IOStream *stream = Assimp::DefaultIOSystem::Open(file, mode);
+    if (stream && source != file && std::find(opened.begin(), opened.end(), file) == opened.end())
+      opened.push_back(file);
+    return stream;
+  }
+};
 
 class Model
 {
 private:
   std::string directory;
+  // 是否在线程池中并行转换各个网格的顶点/索引
+  bool parallelLoad;
+  // 上传到GPU的顶点格式, 缓存里始终是Vertex
+  VertexFormat vertexFormat;
+  // 贴图路径 -> textures_loaded中的下标
+  std::unordered_map<std::string, unsigned int> loadedIndex;
+
+  Model(const Model &) = delete;
+  Model &operator=(const Model &) = delete;
   
   void loadModel(std::string path);
-  void processNode(aiNode *node, const aiScene *scene);
-  Mesh processMesh(aiMesh *mesh, const aiScene *scene);
-  std::vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, std::string typeName);
+  bool loadFromCache(const std::string &path);
+  bool importWithAssimp(const std::string &path, std::vector<MeshData> &meshData, std::vector<std::string> &dependencies);
+  void processNode(aiNode *node, const aiScene *scene, std::vector<aiMesh *> &meshList);
+  MeshData extractMesh(aiMesh *mesh, const aiScene *scene) const;
+  static void optimizeMesh(MeshData &data, VertexCacheStats &before, VertexCacheStats &after);
+  // 当前的导入开关, 写进网格缓存, 开关变了之后旧缓存失效
+  static uint32_t importOptions();
+  Mesh processMesh(MeshData &data);
+  std::vector<Texture> listMaterialTextures(aiMaterial *mat, aiTextureType type, std::string typeName) const;
+  Texture loadMaterialTexture(const Texture &ref);
 public:
   std::vector<Texture> textures_loaded;
   std::vector<Mesh> meshes;
-  Model(std::string const &path)
+  // 是否读写源文件旁边的二进制网格缓存, 缓存有效时完全跳过Assimp
+  static bool meshCacheEnabled;
+  // .obj文件是否用ObjLoader读取, 关掉时和其它格式一样走Assimp
+  static bool objLoaderEnabled;
+  // 导入时是否重排三角形和顶点(顶点缓存、overdraw、顶点读取), 结果会写进网格缓存
+  static bool meshOptimizeEnabled;
+  // 导入时是否用QEM简化生成LOD链, 各级索引放在同一个索引缓冲里, 结果会写进网格缓存
+  static bool meshLodEnabled;
+  // parallel为true时, 网格转换(OBJ还包括解析)在线程池中进行, 只有贴图加载和Mesh::setupMesh留在GL线程
+  // format为VERTEX_PACKED时顶点带宽和显存减半, 着色器要用positionOffset/positionScale还原位置(见rock.vs)
+  Model(std::string const &path, bool parallel = false, VertexFormat format = VERTEX_FLOAT) : parallelLoad(parallel), vertexFormat(format)
   {
     loadModel(path);
   }
-  void Draw(Shader shader);
+  // 贴图由全局的TextureCache管理, 模型销毁时归还引用; 网格析构时自己归还GL资源
+  ~Model()
+  {
+    release();
+  }
+  // 提前归还网格和贴图, 比如在GL上下文销毁之前; 之后Draw什么也不画
+  void release()
+  {
+    for (unsigned int i = 0; i < textures_loaded.size(); i++)
+      TextureCache::instance().release(textures_loaded[i].id);
+    textures_loaded.clear();
+    loadedIndex.clear();
+    meshes.clear();
+  }
+  void Draw(Shader &shader);
+  // 按网格簇做视锥和背面剔除后绘制, cameraPosition是世界空间的相机位置
+  void DrawCulled(Shader &shader, const glm::mat4 &projectionView, const glm::mat4 &model, const glm::vec3 &cameraPosition);
+  // 每个网格按屏幕误差选择LOD, projectionScale用lodProjectionScale(camera.Zoom, 视口高度)计算
+  void DrawLod(Shader &shader, const glm::mat4 &model, const glm::vec3 &cameraPosition, float projectionScale);
 };
 
-void Model::Draw(Shader shader)
+bool Model::meshCacheEnabled = true;
+bool Model::objLoaderEnabled = true;
+bool Model::meshOptimizeEnabled = true;
+bool Model::meshLodEnabled = true;
+
+void Model::Draw(Shader &shader)
 {
   for (unsigned int i = 0; i < meshes.size(); i++)
     meshes[i].Draw(shader);
 }
 
+void Model::DrawCulled(Shader &shader, const glm::mat4 &projectionView, const glm::mat4 &model, const glm::vec3 &cameraPosition)
+{
+  for (unsigned int i = 0; i < meshes.size(); i++)
+    meshes[i].DrawCulled(shader, projectionView, model, cameraPosition);
+}
+
+void Model::DrawLod(Shader &shader, const glm::mat4 &model, const glm::vec3 &cameraPosition, float projectionScale)
+{
+  for (unsigned int i = 0; i < meshes.size(); i++)
+    meshes[i].DrawLod(shader, meshes[i].selectLod(model, cameraPosition, projectionScale));
+}
+
 void Model::loadModel(std::string path)
+{
+  directory = path.substr(0, path.find_last_of("/"));
+  if (meshCacheEnabled && loadFromCache(path))
+    return;
+
+  // OBJ优先用专用读取器, 读取失败(比如遇到不支持的语句组合)时退回Assimp
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::vector<MeshData> meshData;
+  std::vector<std::string> dependencies;
+  const char *importer = "OBJ";
+  bool isObj = path.size() > 4 && path.compare(path.size() - 4, 4, ".obj") == 0;
+  if (!objLoaderEnabled || !isObj || !ObjLoader::load(path, meshData, parallelLoad, dependencies))
+  {
+    importer = "ASSIMP";
+    meshData.clear();
+    dependencies.clear();
+    if (!importWithAssimp(path, meshData, dependencies))
+      return;
+  }
+  if (Diagnostics::verboseLoading)
+  {
+    std::ostringstream line;
+    line << std::fixed << std::setprecision(1) << "MODEL::IMPORT::" << path << " " << importer << ", " << meshData.size() << " meshes in "
+         << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms";
+    std::cout << line.str() << std::endl;
+  }
+
+  std::vector<VertexCacheStats> before(meshData.size()), after(meshData.size());
+  if (parallelLoad && meshData.size() > 1)
+  {
+    // 每个网格的结果写到自己的槽位里, 不需要加锁
+    ThreadPool::shared().parallelFor((unsigned int)meshData.size(), [&meshData, &before, &after](unsigned int i)
+    {
+      optimizeMesh(meshData[i], before[i], after[i]);
+    });
+  }
+  else
+  {
+    for (unsigned int i = 0; i < meshData.size(); i++)
+      optimizeMesh(meshData[i], before[i], after[i]);
+  }
+  if (meshOptimizeEnabled && Diagnostics::verboseLoading)
+  {
+    for (unsigned int i = 0; i < meshData.size(); i++)
+    {
+      std::ostringstream line;
+      line << std::fixed << std::setprecision(3) << "MESH::OPTIMIZE::" << path << " mesh " << i << ": "
+           << (meshData[i].lods.empty() ? (unsigned int)meshData[i].indices.size() / 3 : meshData[i].lods[0].indexCount / 3) << " tris, ACMR "
+           << before[i].acmr << " -> " << after[i].acmr << ", ATVR " << before[i].atvr << " -> " << after[i].atvr;
+      std::cout << line.str() << std::endl;
+    }
+  }
+  for (unsigned int i = 0; i < meshData.size() && Diagnostics::verboseLoading; i++)
+  {
+    if (meshData[i].lods.size() < 2)
+      continue;
+    std::ostringstream line;
+    line << "MESH::LOD::" << path << " mesh " << i << ":";
+    for (unsigned int j = 0; j < meshData[i].lods.size(); j++)
+      line << " " << meshData[i].lods[j].indexCount / 3 << " tris (error " << meshData[i].lods[j].error << ")";
+    std::cout << line.str() << std::endl;
+  }
+
+  if (meshCacheEnabled && !MeshCache::write(path, meshData, dependencies, importOptions()))
+    std::cout << "WARNING::MODEL::failed to write mesh cache for " << path << std::endl;
+
+  // 贴图加载和顶点上传都需要gl上下文, 回到当前线程按顺序完成
+  meshes.reserve(meshData.size());
+  for (unsigned int i = 0; i < meshData.size(); i++)
+    meshes.push_back(processMesh(meshData[i]));
+}
+
+bool Model::importWithAssimp(const std::string &path, std::vector<MeshData> &meshData, std::vector<std::string> &dependencies)
 {
   Assimp::Importer import;
+  // Importer负责释放IOSystem
+  import.SetIOHandler(new RecordingIOSystem(path, dependencies));
   const aiScene *scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
 
   if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
   {
     std::cout << "ERROR::ASSIMP::" << import.GetErrorString() << std::endl;
-    return;
+    return false;
   }
-  directory = path.substr(0, path.find_last_of("/"));
-  processNode(scene->mRootNode, scene);
+
+  // 先按节点遍历顺序收集网格, 保证meshes的顺序和串行加载时一致
+  std::vector<aiMesh *> meshList;
+  processNode(scene->mRootNode, scene, meshList);
+
+  meshData.resize(meshList.size());
+  if (parallelLoad && meshList.size() > 1)
+  {
+    std::vector<std::future<void> > jobs;
+    for (unsigned int i = 0; i < meshList.size(); i++)
+    {
+      jobs.push_back(ThreadPool::shared().submit([this, &meshData, &meshList, scene, i]()
+      {
+        meshData[i] = extractMesh(meshList[i], scene);
+      }));
+    }
+    for (unsigned int i = 0; i < jobs.size(); i++)
+      jobs[i].get();
+  }
+  else
+  {
+    for (unsigned int i = 0; i < meshList.size(); i++)
+      meshData[i] = extractMesh(meshList[i], scene);
+  }
+  return true;
 }
 
-void Model::processNode(aiNode *node, const aiScene *scene)
+bool Model::loadFromCache(const std::string &path)
 {
-  // 处理节点所有的网格
-  for (unsigned int i = 0; i < node->mNumMeshes; i++)
+  MeshCache cache;
+  if (!cache.open(path, importOptions()))
+    return false;
+  // 顶点和索引直接从映射的内存上传, 上传完成后cache析构时解除映射
+  meshes.reserve(cache.meshCount());
+  for (unsigned int i = 0; i < cache.meshCount(); i++)
   {
-    aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
-    meshes.push_back(processMesh(mesh, scene));
+    std::vector<Texture> refs = cache.textures(i);
+    std::vector<Texture> textures;
+    for (unsigned int j = 0; j < refs.size(); j++)
+      textures.push_back(loadMaterialTexture(refs[j]));
+    meshes.push_back(Mesh(cache.vertices(i), cache.vertexCount(i), cache.indices(i), cache.indexCount(i), std::move(textures), vertexFormat));
+    meshes.back().meshlets.assign(cache.meshlets(i), cache.meshlets(i) + cache.meshletCount(i));
+    meshes.back().setLods(cache.lods(i), cache.lodCount(i));
   }
+  return true;
+}
+
+void Model::processNode(aiNode *node, const aiScene *scene, std::vector<aiMesh *> &meshList)
+{
+  // 处理节点所有的网格
+  for (unsigned int i = 0; i < node->mNumMeshes; i++)
+    meshList.push_back(scene->mMeshes[node->mMeshes[i]]);
   for (unsigned int i = 0; i < node->mNumChildren; i++)
-    processNode(node->mChildren[i], scene);
+    processNode(node->mChildren[i], scene, meshList);
 }
 
-Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene)
+MeshData Model::extractMesh(aiMesh *mesh, const aiScene *scene) const
 {
-  std::vector<Vertex> vertices;
-  std::vector<unsigned int> indices;
-  std::vector<Texture> textures;
+  MeshData data;
+  data.vertices.reserve(mesh->mNumVertices);
+  data.indices.reserve(mesh->mNumFaces * 3);
 
   for (unsigned int i = 0; i < mesh->mNumVertices; i++)
   {
@@ -97,96 +307,99 @@ Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene)
     }
     else
       vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+    vertex.Tangent = glm::vec4(0.0f);
     
-    vertices.push_back(vertex);
+    data.vertices.push_back(vertex);
   }
   // 处理索引
   for (unsigned int i = 0; i < mesh->mNumFaces; i++)
   {
     aiFace face = mesh->mFaces[i];
     for (unsigned int j = 0; j < face.mNumIndices; j++)
-      indices.push_back(face.mIndices[j]);
+      data.indices.push_back(face.mIndices[j]);
   }
-  // 处理材质
+  // 处理材质, 这里只记录贴图路径, 真正的加载留给GL线程
   if (mesh->mMaterialIndex >= 0)
   {
     aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
-    std::vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-    textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-    std::vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-    textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-    std::vector<Texture> reflectionMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_reflection");
-    textures.insert(textures.end(), reflectionMaps.begin(), reflectionMaps.end());
-  }
-  return Mesh(vertices, indices, textures) ;
+    std::vector<Texture> diffuseMaps = listMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
+    data.textures.insert(data.textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+    std::vector<Texture> specularMaps = listMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
+    data.textures.insert(data.textures.end(), specularMaps.begin(), specularMaps.end());
+    std::vector<Texture> reflectionMaps = listMaterialTextures(material, aiTextureType_AMBIENT, "texture_reflection");
+    data.textures.insert(data.textures.end(), reflectionMaps.begin(), reflectionMaps.end());
+  }
+  return data;
+}
+
+uint32_t Model::importOptions()
+{
+  return (meshOptimizeEnabled ? MESH_IMPORT_OPTIMIZE : 0) | (meshLodEnabled ? MESH_IMPORT_LOD : 0);
+}
+
+void Model::optimizeMesh(MeshData &data, VertexCacheStats &before, VertexCacheStats &after)
+{
+  // 切线只依赖三角形和顶点属性, 不受后面重排的影响; LOD共用这些顶点, 所以要在简化之前生成
+  TangentSpace::generate(data.vertices, data.indices);
+  if (meshOptimizeEnabled)
+  {
+    before = MeshOptimizer::analyze(data.indices, (unsigned int)data.vertices.size());
+    MeshOptimizer::optimize(data);
+    after = MeshOptimizer::analyze(data.indices, (unsigned int)data.vertices.size());
+  }
+  // 簇按最终的三角形顺序切分, 所以放在优化之后; LOD追加在索引后面, 簇只覆盖LOD0
+  MeshletBuilder::build(data.vertices, data.indices, data.meshlets);
+  if (meshLodEnabled)
+    MeshSimplifier::buildLods(data);
+}
+
+Mesh Model::processMesh(MeshData &data)
+{
+  std::vector<Texture> textures;
+  for (unsigned int i = 0; i < data.textures.size(); i++)
+    textures.push_back(loadMaterialTexture(data.textures[i]));
+  return Mesh(std::move(data), std::move(textures), vertexFormat);
 }
 
-std::vector<Texture> Model::loadMaterialTextures(aiMaterial *mat, aiTextureType type, std::string typeName)
+std::vector<Texture> Model::listMaterialTextures(aiMaterial *mat, aiTextureType type, std::string typeName) const
 {
   std::vector<Texture> textures;
   for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
   {
     aiString str;
     mat->GetTexture(type, i, &str);
-    bool skip = false;
-    for (unsigned int j = 0; j < textures_loaded.size(); j++)
-    {
-      if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-      {
-        textures.push_back(textures_loaded[j]);
-        skip = true;
-        break;
-      }
-    }
-    if (!skip)
-    {
-      Texture texture;
-      texture.id = TextureFromFile(str.C_Str(), directory);
-      texture.type = typeName;
-      texture.path = str.C_Str();
-      textures.push_back(texture);
-      textures_loaded.push_back(texture);
-    }
+    Texture texture;
+    texture.id = 0;
+    texture.type = typeName;
+    texture.path = str.C_Str();
+    textures.push_back(texture);
   }
   return textures;
 }
 
-unsigned int TextureFromFile(char const * path, const std::string &directory, bool gamma)
+Texture Model::loadMaterialTexture(const Texture &ref)
+{
+  std::unordered_map<std::string, unsigned int>::iterator it = loadedIndex.find(ref.path);
+  if (it != loadedIndex.end())
+    return textures_loaded[it->second];
+  Texture texture;
+  // 漫反射是颜色贴图, 高光和反射强度只用到一个通道
+  TextureUsage usage = ref.type == "texture_diffuse" ? TEXTURE_COLOR : TEXTURE_MASK;
+  texture.id = TextureFromFile(ref.path.c_str(), directory, false, usage);
+  texture.type = ref.type;
+  texture.path = ref.path;
+  loadedIndex[ref.path] = (unsigned int)textures_loaded.size();
+  textures_loaded.push_back(texture);
+  return texture;
+}
+
+// 从全局TextureCache取贴图, 内容相同的图片在所有模型间共享同一个GL纹理
+// 返回的纹理带一次引用, 不再使用时调用TextureCache::instance().release
+unsigned int TextureFromFile(char const * path, const std::string &directory, bool gamma, TextureUsage usage)
 {
   std::string filename = std::string(path);
   filename = directory + '/' + filename;
 
-  unsigned int textureID;
-  glGenTextures(1, &textureID);
-
-  int width, height, nrChannels;
-  unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrChannels, 0);
-  if (data)
-  {
-    GLenum format;
-    if (nrChannels == 1)
-      format = GL_RED;
-    else if (nrChannels == 3)
-      format = GL_RGB;
-    else if (nrChannels == 4)
-      format = GL_RGBA;
-
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    stbi_image_free(data);
-  }
-  else
-  {
-    std::cout << "Failed to load texture" << std::endl;
-    stbi_image_free(data);
-  }
-  return textureID;
+  return TextureCache::instance().acquire(filename, TextureOptions(gamma, false, usage));
 }
 #endif
\ No newline at end of file
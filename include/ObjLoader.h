@@ -0,0 +1,491 @@
+#ifndef OBJ_LOADER_H
+#define OBJ_LOADER_H
+
+#include <map>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <functional>
+#include <iostream>
+#include <vector>
+#include <stdint.h>
+
+#include <glm/glm.hpp>
+
+#include <MappedFile.h>
+#include <Mesh.h>
+#include <ThreadPool.h>
+
+// Wavefront OBJ/MTL的专用读取器, 绕过Assimp
+// 文件映射到内存后按行边界切成若干块并行解析, 每块记下自己的顶点属性、面和对象/材质切换,
+// 合并时再把相对索引换成绝对索引; 然后每个网格在线程池里用开放寻址哈希表合并相同的v/vt/vn组合
+// 输出和Model用Assimp(aiProcess_Triangulate | aiProcess_FlipUVs)得到的MeshData一致(切线由Model统一生成):
+// 每个对象/组里每段材质一个网格, 多边形按扇形三角化, 纹理坐标v翻转; 没有法线时用面法线累加
+class ObjLoader
+{
+private:
+  // 面的一个角, 依次是v/vt/vn; 没有写的分量是-1
+  // relative的第k位为1时第k个分量是块内的相对位置, 合并时加上前面所有块的数量
+  struct Corner
+  {
+    int index[3];
+    int relative;
+  };
+
+  // 从第corner个角开始切换对象/组(material为false)或者材质
+  struct Switch
+  {
+    size_t corner;
+    bool material;
+    std::string name;
+  };
+
+  struct Chunk
+  {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> texCoords;
+    std::vector<glm::vec3> normals;
+    std::vector<Corner> corners; // 已经三角化, 每3个一个三角形
+    std::vector<Switch> switches;
+    std::vector<std::string> libraries;
+  };
+
+  // 块解析成功后, 按网格切分好的一段角
+  struct Group
+  {
+    size_t begin;
+    size_t end;
+    std::string material;
+  };
+
+  static const char *skipSpaces(const char *p, const char *end);
+  static const char *skipLine(const char *p, const char *end);
+  static std::string restOfLine(const char *p, const char *end);
+  static const char *parseFloat(const char *p, const char *end, float &value);
+  static const char *parseInt(const char *p, const char *end, int &value, bool &ok);
+  static bool parseChunk(const char *begin, const char *end, Chunk &chunk);
+  static bool loadMaterials(const std::string &path, std::map<std::string, std::vector<Texture> > &materials);
+  static void buildMesh(const std::vector<glm::vec3> &positions, const std::vector<glm::vec2> &texCoords, const std::vector<glm::vec3> &normals,
+                        const Corner *corners, size_t count, MeshData &mesh);
+public:
+  // 小于这个大小的文件不切块
+  static const size_t CHUNK_SIZE = 256 * 1024;
+
+  // parallel为true时解析和网格构建都在共享线程池里进行; 文件不能读取或者格式有误时返回false
+  // materialFiles返回引用到的.mtl路径(包括读取失败的), 网格缓存用它们判断是否过期
+  static bool load(const std::string &path, std::vector<MeshData> &meshes, bool parallel, std::vector<std::string> &materialFiles);
+};
+
+const char *ObjLoader::skipSpaces(const char *p, const char *end)
+{
+  while (p < end && (*p == ' ' || *p == '\t'))
+    p++;
+  return p;
+}
+
+const char *ObjLoader::skipLine(const char *p, const char *end)
+{
+  while (p < end && *p != '\n')
+    p++;
+  return p < end ? p + 1 : end;
+}
+
+std::string ObjLoader::restOfLine(const char *p, const char *end)
+{
+  p = skipSpaces(p, end);
+  const char *stop = p;
+  while (stop < end && *stop != '\n' && *stop != '\r')
+    stop++;
+  while (stop > p && (stop[-1] == ' ' || stop[-1] == '\t'))
+    stop--;
+  return std::string(p, stop);
+}
+
+const char *ObjLoader::parseFloat(const char *p, const char *end, float &value)
+{
+  // 快速路径: 有效数字先累加成64位整数, 最后乘或除一次10的幂; 10^22以内的幂是精确的double
+  static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                   1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+  p = skipSpaces(p, end);
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+'))
+    negative = *p++ == '-';
+  uint64_t mantissa = 0;
+  int exponent = 0, digits = 0;
+  const char *start = p;
+  for (; p < end && *p >= '0' && *p <= '9'; p++)
+  {
+    if (digits < 18)
+    {
+      mantissa = mantissa * 10 + (*p - '0');
+      digits += mantissa != 0 ? 1 : 0;
+    }
+    else
+      exponent++;
+  }
+  if (p < end && *p == '.')
+  {
+    for (p++; p < end && *p >= '0' && *p <= '9'; p++)
+    {
+      if (digits < 18)
+      {
+        mantissa = mantissa * 10 + (*p - '0');
+        digits += mantissa != 0 ? 1 : 0;
+        exponent--;
+      }
+    }
+  }
+  if (p == start)
+    return nullptr;
+  if (p < end && (*p == 'e' || *p == 'E'))
+  {
+    p++;
+    bool negativeExponent = false;
+    if (p < end && (*p == '-' || *p == '+'))
+      negativeExponent = *p++ == '-';
+    int e = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++)
+      e = e < 10000 ? e * 10 + (*p - '0') : e;
+    exponent += negativeExponent ? -e : e;
+  }
+  double result = (double)mantissa;
+  if (exponent > 0)
+    result *= exponent <= 22 ? powers[exponent] : std::pow(10.0, exponent);
+  else if (exponent < 0)
+    result /= -exponent <= 22 ? powers[-exponent] : std::pow(10.0, -exponent);
+  value = (float)(negative ? -result : result);
+  return p;
+}
+
+const char *ObjLoader::parseInt(const char *p, const char *end, int &value, bool &ok)
+{
+  bool negative = false;
+  if (p < end && *p == '-')
+  {
+    negative = true;
+    p++;
+  }
+  const char *start = p;
+  long long result = 0;
+  for (; p < end && *p >= '0' && *p <= '9'; p++)
+    result = result < 0x7fffffff ? result * 10 + (*p - '0') : result;
+  ok = p != start && result <= 0x7fffffff;
+  value = (int)(negative ? -result : result);
+  return p;
+}
+
+bool ObjLoader::parseChunk(const char *begin, const char *end, Chunk &chunk)
+{
+  std::vector<Corner> polygon;
+  const char *p = begin;
+  while (p < end)
+  {
+    p = skipSpaces(p, end);
+    if (p >= end)
+      break;
+    const char *line = p;
+    if (line[0] == 'v' && line + 1 < end && (line[1] == ' ' || line[1] == '\t'))
+    {
+      glm::vec3 v(0.0f);
+      for (int k = 0; k < 3 && p; k++)
+        p = parseFloat(k == 0 ? line + 1 : p, end, v[k]);
+      if (!p)
+        return false;
+      chunk.positions.push_back(v);
+    }
+    else if (line[0] == 'v' && line + 2 < end && line[1] == 't' && (line[2] == ' ' || line[2] == '\t'))
+    {
+      // 第3个分量(w)忽略; FlipUVs
+      glm::vec2 t(0.0f);
+      p = parseFloat(line + 2, end, t.x);
+      if (p)
+        p = parseFloat(p, end, t.y);
+      if (!p)
+        return false;
+      t.y = 1.0f - t.y;
+      chunk.texCoords.push_back(t);
+    }
+    else if (line[0] == 'v' && line + 2 < end && line[1] == 'n' && (line[2] == ' ' || line[2] == '\t'))
+    {
+      glm::vec3 n(0.0f);
+      for (int k = 0; k < 3 && p; k++)
+        p = parseFloat(k == 0 ? line + 2 : p, end, n[k]);
+      if (!p)
+        return false;
+      chunk.normals.push_back(n);
+    }
+    else if (line[0] == 'f' && line + 1 < end && (line[1] == ' ' || line[1] == '\t'))
+    {
+      int counts[3] = { (int)chunk.positions.size(), (int)chunk.texCoords.size(), (int)chunk.normals.size() };
+      polygon.clear();
+      p = skipSpaces(line + 1, end);
+      while (p < end && *p != '\n' && *p != '\r' && *p != '#')
+      {
+        Corner corner = { { -1, -1, -1 }, 0 };
+        for (int k = 0; k < 3; k++)
+        {
+          if (k > 0)
+          {
+            if (p >= end || *p != '/')
+              break;
+            p++;
+            // v//vn: 纹理坐标为空
+            if (p < end && *p == '/')
+              continue;
+          }
+          int value;
+          bool ok;
+          p = parseInt(p, end, value, ok);
+          if (!ok || value == 0)
+            return false;
+          if (value > 0)
+            corner.index[k] = value - 1;
+          else
+          {
+            corner.index[k] = counts[k] + value;
+            corner.relative |= 1 << k;
+          }
+        }
+        polygon.push_back(corner);
+        p = skipSpaces(p, end);
+      }
+      for (size_t i = 2; i < polygon.size(); i++)
+      {
+        chunk.corners.push_back(polygon[0]);
+        chunk.corners.push_back(polygon[i - 1]);
+        chunk.corners.push_back(polygon[i]);
+      }
+    }
+    else if ((line[0] == 'o' || line[0] == 'g') && line + 1 < end && (line[1] == ' ' || line[1] == '\t' || line[1] == '\n' || line[1] == '\r'))
+    {
+      Switch change = { chunk.corners.size(), false, restOfLine(line + 1, end) };
+      chunk.switches.push_back(change);
+    }
+    else if (end - line > 7 && strncmp(line, "usemtl", 6) == 0 && (line[6] == ' ' || line[6] == '\t'))
+    {
+      Switch change = { chunk.corners.size(), true, restOfLine(line + 6, end) };
+      chunk.switches.push_back(change);
+    }
+    else if (end - line > 7 && strncmp(line, "mtllib", 6) == 0 && (line[6] == ' ' || line[6] == '\t'))
+      chunk.libraries.push_back(restOfLine(line + 6, end));
+    // 注释、s、l等其它语句直接跳过
+    p = skipLine(p ? p : line, end);
+  }
+  return true;
+}
+
+bool ObjLoader::loadMaterials(const std::string &path, std::map<std::string, std::vector<Texture> > &materials)
+{
+  MappedFile file;
+  if (!file.open(path))
+    return false;
+  const char *p = (const char *)file.data(), *end = p + file.size();
+  std::vector<Texture> *current = nullptr;
+  while (p < end)
+  {
+    p = skipSpaces(p, end);
+    std::string type;
+    if (end - p > 7 && strncmp(p, "newmtl", 6) == 0)
+      current = &materials[restOfLine(p + 6, end)];
+    else if (current && end - p > 7 && strncmp(p, "map_Kd", 6) == 0)
+      type = "texture_diffuse";
+    else if (current && end - p > 7 && strncmp(p, "map_Ks", 6) == 0)
+      type = "texture_specular";
+    else if (current && end - p > 7 && strncmp(p, "map_Ka", 6) == 0)
+      type = "texture_reflection";
+    if (!type.empty())
+    {
+      // 贴图选项(-bm等)写在文件名前面, 取最后一项
+      std::string line = restOfLine(p + 6, end);
+      size_t space = line.find_last_of(" \t");
+      Texture texture;
+      texture.id = 0;
+      texture.type = type;
+      texture.path = space == std::string::npos ? line : line.substr(space + 1);
+      current->push_back(texture);
+    }
+    p = skipLine(p, end);
+  }
+  return true;
+}
+
+void ObjLoader::buildMesh(const std::vector<glm::vec3> &positions, const std::vector<glm::vec2> &texCoords, const std::vector<glm::vec3> &normals,
+                          const Corner *corners, size_t count, MeshData &mesh)
+{
+  // 开放寻址哈希表, 容量是2的幂并且至少是角数的2倍, 线性探测
+  size_t capacity = 16;
+  while (capacity < count * 2)
+    capacity *= 2;
+  std::vector<unsigned int> table(capacity, 0xffffffffu);
+  std::vector<const Corner *> unique;
+  mesh.indices.resize(count);
+  for (size_t i = 0; i < count; i++)
+  {
+    const int *key = corners[i].index;
+    uint32_t hash = (uint32_t)key[0] * 73856093u ^ (uint32_t)key[1] * 19349663u ^ (uint32_t)key[2] * 83492791u;
+    size_t slot = hash & (capacity - 1);
+    while (table[slot] != 0xffffffffu)
+    {
+      const int *other = unique[table[slot]]->index;
+      if (other[0] == key[0] && other[1] == key[1] && other[2] == key[2])
+        break;
+      slot = (slot + 1) & (capacity - 1);
+    }
+    if (table[slot] == 0xffffffffu)
+    {
+      table[slot] = (unsigned int)unique.size();
+      unique.push_back(&corners[i]);
+    }
+    mesh.indices[i] = table[slot];
+  }
+
+  bool computeNormals = false;
+  mesh.vertices.resize(unique.size());
+  for (size_t i = 0; i < unique.size(); i++)
+  {
+    const int *key = unique[i]->index;
+    Vertex &vertex = mesh.vertices[i];
+    vertex.Position = positions[key[0]];
+    vertex.TexCoords = key[1] >= 0 ? texCoords[key[1]] : glm::vec2(0.0f);
+    vertex.Normal = key[2] >= 0 ? normals[key[2]] : glm::vec3(0.0f);
+    vertex.Tangent = glm::vec4(0.0f);
+    computeNormals = computeNormals || key[2] < 0;
+  }
+  if (!computeNormals)
+    return;
+  // 缺少法线的顶点用相邻三角形的面积加权法线
+  for (size_t t = 0; t + 2 < count; t += 3)
+  {
+    Vertex &a = mesh.vertices[mesh.indices[t]], &b = mesh.vertices[mesh.indices[t + 1]], &c = mesh.vertices[mesh.indices[t + 2]];
+    glm::vec3 normal = glm::cross(b.Position - a.Position, c.Position - a.Position);
+    for (int k = 0; k < 3; k++)
+      if (corners[t + k].index[2] < 0)
+        mesh.vertices[mesh.indices[t + k]].Normal += normal;
+  }
+  for (size_t i = 0; i < unique.size(); i++)
+    if (unique[i]->index[2] < 0)
+    {
+      float length = glm::length(mesh.vertices[i].Normal);
+      mesh.vertices[i].Normal = length > 0.0f ? mesh.vertices[i].Normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+    }
+}
+
+bool ObjLoader::load(const std::string &path, std::vector<MeshData> &meshes, bool parallel, std::vector<std::string> &materialFiles)
+{
+  MappedFile file;
+  if (!file.open(path))
+    return false;
+  const char *data = (const char *)file.data();
+  size_t size = file.size();
+
+  // 切块, 每块的结尾挪到行尾
+  std::vector<const char *> bounds(1, data);
+  size_t chunkCount = parallel ? (size + CHUNK_SIZE - 1) / CHUNK_SIZE : 1;
+  for (size_t i = 1; i < chunkCount; i++)
+  {
+    const char *cut = data + size * i / chunkCount;
+    if (cut <= bounds.back())
+      continue;
+    cut = skipLine(cut, data + size);
+    if (cut > bounds.back() && cut < data + size)
+      bounds.push_back(cut);
+  }
+  bounds.push_back(data + size);
+
+  std::vector<Chunk> chunks(bounds.size() - 1);
+  std::vector<char> parsed(chunks.size(), 0);
+  std::function<void(unsigned int)> parse = [&](unsigned int i) { parsed[i] = parseChunk(bounds[i], bounds[i + 1], chunks[i]); };
+  if (chunks.size() > 1)
+    ThreadPool::shared().parallelFor((unsigned int)chunks.size(), parse);
+  else
+    parse(0);
+
+  // 合并顶点属性, 把相对索引换成绝对索引并检查越界
+  std::vector<glm::vec3> positions, normals;
+  std::vector<glm::vec2> texCoords;
+  std::vector<Corner> corners;
+  std::vector<Group> groups;
+  std::vector<std::string> libraries;
+  std::string material;
+  size_t groupStart = 0;
+  for (unsigned int i = 0; i < chunks.size(); i++)
+  {
+    if (!parsed[i])
+      return false;
+    Chunk &chunk = chunks[i];
+    int base[3] = { (int)positions.size(), (int)texCoords.size(), (int)normals.size() };
+    positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+    texCoords.insert(texCoords.end(), chunk.texCoords.begin(), chunk.texCoords.end());
+    normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+    int limits[3] = { (int)positions.size(), (int)texCoords.size(), (int)normals.size() };
+
+    size_t offset = corners.size();
+    for (size_t c = 0; c < chunk.corners.size(); c++)
+    {
+      Corner corner = chunk.corners[c];
+      for (int k = 0; k < 3; k++)
+      {
+        bool missing = corner.index[k] == -1 && !(corner.relative & (1 << k));
+        if (corner.relative & (1 << k))
+          corner.index[k] += base[k];
+        if (missing ? k == 0 : corner.index[k] < 0 || corner.index[k] >= limits[k])
+          return false;
+      }
+      corner.relative = 0;
+      corners.push_back(corner);
+    }
+    // 对象/组或材质切换时结束当前网格
+    for (size_t s = 0; s < chunk.switches.size(); s++)
+    {
+      size_t at = offset + chunk.switches[s].corner;
+      if (at > groupStart)
+      {
+        Group group = { groupStart, at, material };
+        groups.push_back(group);
+        groupStart = at;
+      }
+      if (chunk.switches[s].material)
+        material = chunk.switches[s].name;
+    }
+    libraries.insert(libraries.end(), chunk.libraries.begin(), chunk.libraries.end());
+  }
+  if (corners.size() > groupStart)
+  {
+    Group group = { groupStart, corners.size(), material };
+    groups.push_back(group);
+  }
+  chunks.clear();
+
+  // 材质库相对于OBJ所在目录; 缺失时只是没有贴图
+  std::string directory = path.substr(0, path.find_last_of("/") + 1);
+  std::map<std::string, std::vector<Texture> > materials;
+  for (size_t i = 0; i < libraries.size(); i++)
+  {
+    materialFiles.push_back(directory + libraries[i]);
+    if (!loadMaterials(directory + libraries[i], materials))
+      std::cout << "WARNING::OBJ::failed to read material library " << directory + libraries[i] << std::endl;
+  }
+
+  meshes.assign(groups.size(), MeshData());
+  std::function<void(unsigned int)> build = [&](unsigned int i)
+  {
+    buildMesh(positions, texCoords, normals, &corners[groups[i].begin], groups[i].end - groups[i].begin, meshes[i]);
+    // 和Model::extractMesh一样按diffuse、specular、reflection的顺序排列
+    static const char *order[] = { "texture_diffuse", "texture_specular", "texture_reflection" };
+    std::map<std::string, std::vector<Texture> >::const_iterator found = materials.find(groups[i].material);
+    if (found == materials.end())
+      return;
+    for (int k = 0; k < 3; k++)
+      for (size_t j = 0; j < found->second.size(); j++)
+        if (found->second[j].type == order[k])
+          meshes[i].textures.push_back(found->second[j]);
+  };
+  if (parallel && groups.size() > 1)
+    ThreadPool::shared().parallelFor((unsigned int)groups.size(), build);
+  else
+    for (unsigned int i = 0; i < groups.size(); i++)
+      build(i);
+  return true;
+}
+
+#endif
@@ -6,142 +6,267 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include <string>
-#include <fstream>
-#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <stdint.h>
+
+#include <Diagnostics.h>
+#include <GLExtensions.h>
+#include <GLState.h>
+#include <MappedFile.h>
+#include <ShaderPreprocessor.h>
+#include <ShaderStageCache.h>
+#include <UniformBuffers.h>
+
+// 所有着色器共用的uniform统计, 每帧调用endFrame取出并清零
+// 稳定运行时locationQueries应该一直是0, 位置只在链接时查询
+struct UniformStats
+{
+  unsigned long long locationQueries; // glGetUniformLocation的调用次数
+  unsigned long long lookups;         // 按名字查表的次数, 用Uniform句柄时不计
+  unsigned long long misses;          // 名字不是活跃uniform的次数, 这些设置会被忽略
+  unsigned long long uploads;         // 实际发出的glUniform*调用
+  unsigned long long skipped;         // 值和上次相同而省掉的调用
+
+  static UniformStats &current()
+  {
+    static UniformStats stats = { 0, 0, 0, 0, 0 };
+    return stats;
+  }
+
+  static UniformStats endFrame()
+  {
+    UniformStats last = current();
+    current() = UniformStats();
+    return last;
+  }
+
+  // 和上一帧相比上传或者省掉的次数变了, 或者有位置查询、查不到的名字时打印, 稳定的帧不重复打印
+  void print(const UniformStats &previous) const
+  {
+    if (locationQueries == 0 && misses == 0 && uploads == previous.uploads && skipped == previous.skipped)
+      return;
+    std::cout << "UNIFORMS:: " << uploads << " uploads, " << skipped << " skipped, " << locationQueries << " location queries, "
+              << lookups << " lookups, " << misses << " misses" << std::endl;
+  }
+};
+
+// 程序二进制缓存文件(xxx.vs.xxx.fs.program): 文件头 | glGetProgramBinary取出的数据
+// 修改了文件布局时要增加版本号
+const uint32_t PROGRAM_BINARY_VERSION = 1;
+
+struct ProgramBinaryHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t binaryFormat;
+  uint64_t key;
+  uint64_t binarySize;
+};
+
+// 解析好的uniform位置, T是uniform的类型, 只能交给对应类型的Shader::set
+// 位置是-1时设置被GL忽略, 和被优化掉的uniform行为一致
+template <typename T>
+struct Uniform
+{
+  GLint location;
+  Uniform() : location(-1) {}
+  explicit Uniform(GLint loc) : location(loc) {}
+  bool valid() const { return location >= 0; }
+};
 
 class Shader
 {
 public:
   // 程序ID
   unsigned int ID;
-  // 用着色器语言文件路径构建着色器
-  Shader(const GLchar* vertexPath, const GLchar* fragmentPath, const GLchar* geometryPath = nullptr)
-  {
-    // 1. 从文件路径获取顶点/片段着色器/几何着色器
-    // ----------------------------
-    std::string vertexCode;
-    std::string fragmentCode;
-    std::string geometryCode;
-    std::ifstream vShaderFile;
-    std::ifstream fShaderFile;
-    std::ifstream gShaderFile;
-    // 保证ifstream对象可以抛出异常
-    vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-    fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-    gShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-    try
-    {
-      // 打开文件
-      vShaderFile.open(vertexPath);
-      fShaderFile.open(fragmentPath);
-      std::stringstream vShaderStream, fShaderStream;
-      // 读取文件内容到数据流
-      vShaderStream << vShaderFile.rdbuf();
-      fShaderStream << fShaderFile.rdbuf();
-      // 关闭文件处理器
-      vShaderFile.close();
-      fShaderFile.close();
-      // 转换数据流到string
-      vertexCode = vShaderStream.str();
-      fragmentCode = fShaderStream.str();
-      if (geometryPath != nullptr)
-      {
-        gShaderFile.open(geometryPath);
-        std::stringstream gShaderStream;
-        gShaderStream << gShaderFile.rdbuf();
-        gShaderFile.close();
-        geometryCode = gShaderStream.str();
-      }
-    }
-    catch(std::ifstream::failure e)
-    {
-      std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ" << std::endl;
-    }
-    const char* vShaderCode = vertexCode.c_str();
-    const char* fShaderCode = fragmentCode.c_str();
-
-    // 2. 编译着色器
-    // ------------
-    unsigned int vertex, fragment;
-    // 顶点着色器
-    vertex = glCreateShader(GL_VERTEX_SHADER);
-    // 第二个参数是源代码字符串数量
-    glShaderSource(vertex, 1, &vShaderCode, NULL);
-    glCompileShader(vertex);
-    // 打印编译错误(如果有的话)
-    checkCompileErrors(vertex, "VERTEX");
-    // 片段着色器
-    fragment = glCreateShader(GL_FRAGMENT_SHADER);
-    // 第二个参数是源代码字符串数量
-    glShaderSource(fragment, 1, &fShaderCode, NULL);
-    glCompileShader(fragment);
-    // 打印编译错误(如果有的话)
-    checkCompileErrors(fragment, "FRAGMENT");
-    // 几何着色器
-    unsigned int geometry;
-    if (geometryPath != nullptr)
-    {
-      const char* gShaderCode = geometryCode.c_str();
-      geometry = glCreateShader(GL_GEOMETRY_SHADER);
-      glShaderSource(geometry, 1, &gShaderCode, NULL);
-      glCompileShader(geometry);
-      checkCompileErrors(geometry, "GEOMETRY");
-    }
-    // 着色器程序
-    ID = glCreateProgram();
-    glAttachShader(ID, vertex);
-    glAttachShader(ID, fragment);
-    if (geometryPath != nullptr)
-    {
-      glAttachShader(ID, geometry);
-    }
-    glLinkProgram(ID);
-    // 打印连接错误(如果有的话)
-    checkCompileErrors(ID, "PROGRAM");
-    // 删除着色器, 它们已经链接到我们的程序中了, 已经不再需要了
-    glDeleteShader(vertex);
-    glDeleteShader(fragment);
-    if (geometryPath != nullptr)
-    {
-      glDeleteShader(geometry);
-    }
+  // 着色器只用到location 0的位置属性, Mesh会用只有位置的顶点流绘制
+  bool positionOnly;
+  // 是否把链接好的程序二进制缓存到磁盘, 下次启动跳过编译和链接; 驱动不支持时自动关闭
+  static bool binaryCacheEnabled;
+  // 是否跳过和上次相同的uniform设置
+  static bool uniformShadowEnabled;
+  // 用着色器语言文件路径构建着色器, 等到编译链接完成才返回
+  Shader(const GLchar* vertexPath, const GLchar* fragmentPath, const GLchar* geometryPath = nullptr, const ShaderDefines &defines = ShaderDefines())
+    : ID(0), positionOnly(false), finished(true)
+  {
+    submit(vertexPath, fragmentPath, geometryPath, defines);
+    finish();
   }
-  // 激活程序
+  // 空的着色器, 之后调用submit
+  Shader() : ID(0), positionOnly(false), finished(true) {}
+  // 每个对象各自记录uniform的影子值, 两个副本交替设置同一个程序会互相看不到对方的修改, 所以不能拷贝
+  Shader(const Shader &) = delete;
+  Shader &operator=(const Shader &) = delete;
+  // 删除程序, 还没有finish时先归还着色器对象; 要在GL上下文销毁之前析构
+  ~Shader();
+  // 读取源码并提交编译和链接, 不查询任何状态, 驱动可以在后台编译; 结果在finish里检查
+  // defines插入到每个阶段的#version之后, 不同的定义是不同的变体
+  void submit(const GLchar* vertexPath, const GLchar* fragmentPath, const GLchar* geometryPath = nullptr, const ShaderDefines &defines = ShaderDefines());
+  // 不阻塞地查询编译链接是否完成, 驱动不支持并行编译时只有finish之后才返回true
+  bool isReady() const;
+  // 等待编译链接完成, 打印错误, 写程序二进制缓存, 建立uniform表; 已经完成时直接返回
+  void finish();
+  bool isFinished() const { return finished; }
+  bool usesPositionOnly() const
+  {
+    return positionOnly;
+  }
+  // 激活程序, 第一次使用时等待编译链接完成
   void use()
   {
-    glUseProgram(ID);
+    if (!finished)
+      finish();
+    GLState::instance().useProgram(ID);
   }
-  // uniform工具函数
-  void setBool(const std::string& name, bool value) const
+  // 按名字查uniform位置, 查的是finish时建好的表, 不调用GL也不分配内存; 不是活跃uniform时返回-1
+  // 表在finish时才建立, 还在编译的程序先在这里等待完成, 否则所有名字都会查不到
+  GLint uniformLocation(const char *name);
+  // 在循环外解析一次, 之后用set设置
+  template <typename T>
+  Uniform<T> uniform(const char *name)
   {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+    return Uniform<T>(uniformLocation(name));
   }
-  void setInt(const std::string& name, int value) const
+  // 绘制时才确定名字的uniform(比如Mesh的采样器)先登记成序号, 序号在所有着色器里通用, 同一个名字总是同一个序号
+  static unsigned int uniformId(const std::string &name);
+  // 每个着色器对每个序号只按名字解析一次, 之后直接取句柄; 不是活跃uniform的名字也只在第一次计入misses
+  template <typename T>
+  Uniform<T> uniform(unsigned int id)
   {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    if (id >= registeredLocations.size())
+      registeredLocations.resize(registeredNames().size(), UNRESOLVED);
+    if (registeredLocations[id] == UNRESOLVED)
+      registeredLocations[id] = uniformLocation(registeredNames()[id].c_str());
+    return Uniform<T>(registeredLocations[id]);
   }
-  void setFloat(const std::string& name, float value) const
+  // 设置的是当前use的程序; 值和这个程序里上次设置的相同时不调用glUniform*
+  void set(Uniform<bool> uniform, bool value) const { set(Uniform<int>(uniform.location), (int)value); }
+  void set(Uniform<int> uniform, int value) const
   {
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    if (shadowChanged(uniform.location, &value, sizeof(value)))
+      glUniform1i(uniform.location, value);
   }
-  void setMat4(const std::string& name, glm::mat4 value) const
+  void set(Uniform<float> uniform, float value) const
   {
-    unsigned int loc = glGetUniformLocation(ID, name.c_str());
-    glUniformMatrix4fv(loc, 1, GL_FALSE, glm::value_ptr(value));
+    if (shadowChanged(uniform.location, &value, sizeof(value)))
+      glUniform1f(uniform.location, value);
   }
-  void setVec3(const std::string& name, glm::vec3 value) const
+  void set(Uniform<glm::vec2> uniform, const glm::vec2 &value) const
   {
-    unsigned int loc = glGetUniformLocation(ID, name.c_str());
-    glUniform3fv(loc, 1, glm::value_ptr(value));
+    if (shadowChanged(uniform.location, glm::value_ptr(value), sizeof(value)))
+      glUniform2fv(uniform.location, 1, glm::value_ptr(value));
   }
-  void setVec2(const std::string& name, glm::vec2 value) const
+  void set(Uniform<glm::vec3> uniform, const glm::vec3 &value) const
   {
-    unsigned int loc = glGetUniformLocation(ID, name.c_str());
-    glUniform2fv(loc, 1, glm::value_ptr(value));
+    if (shadowChanged(uniform.location, glm::value_ptr(value), sizeof(value)))
+      glUniform3fv(uniform.location, 1, glm::value_ptr(value));
   }
+  void set(Uniform<glm::mat4> uniform, const glm::mat4 &value) const
+  {
+    if (shadowChanged(uniform.location, glm::value_ptr(value), sizeof(value)))
+      glUniformMatrix4fv(uniform.location, 1, GL_FALSE, glm::value_ptr(value));
+  }
+
+  // uniform工具函数, 字符串字面量走const char *版本, 不会构造std::string; 和uniform一样会等待编译链接完成
+  void setBool(const char *name, bool value) { set(uniform<bool>(name), value); }
+  void setInt(const char *name, int value) { set(uniform<int>(name), value); }
+  void setFloat(const char *name, float value) { set(uniform<float>(name), value); }
+  void setMat4(const char *name, const glm::mat4 &value) { set(uniform<glm::mat4>(name), value); }
+  void setVec3(const char *name, const glm::vec3 &value) { set(uniform<glm::vec3>(name), value); }
+  void setVec2(const char *name, const glm::vec2 &value) { set(uniform<glm::vec2>(name), value); }
+  void setBool(const std::string& name, bool value) { setBool(name.c_str(), value); }
+  void setInt(const std::string& name, int value) { setInt(name.c_str(), value); }
+  void setFloat(const std::string& name, float value) { setFloat(name.c_str(), value); }
+  void setMat4(const std::string& name, const glm::mat4 &value) { setMat4(name.c_str(), value); }
+  void setVec3(const std::string& name, const glm::vec3 &value) { setVec3(name.c_str(), value); }
+  void setVec2(const std::string& name, const glm::vec2 &value) { setVec2(name.c_str(), value); }
 
 private:
+  // 活跃uniform的开放寻址哈希表, 容量是2的幂; 名字都存在uniformNames里, length为0的槽位是空的
+  struct UniformSlot
+  {
+    uint32_t hash;
+    GLint location;
+    uint32_t nameOffset;
+    uint32_t nameLength;
+  };
+  std::vector<UniformSlot> uniformSlots;
+  std::string uniformNames;
+
+  // 按uniformId的序号记录解析过的位置, 重新链接时清空
+  enum { UNRESOLVED = -2 };
+  std::vector<GLint> registeredLocations;
+  static std::vector<std::string> &registeredNames()
+  {
+    static std::vector<std::string> names;
+    return names;
+  }
+
+  // 每个uniform位置上次设置的值, 按位比较; 只有set会改uniform, 所以和GL里的值一致
+  // 位置超出范围(个别驱动的位置不连续)时不做比较, 总是上传
+  struct UniformShadow
+  {
+    unsigned char data[sizeof(glm::mat4)];
+    bool valid;
+  };
+  static const GLint MAX_SHADOW_LOCATION = 4096;
+  mutable std::vector<UniformShadow> shadows;
+  // 返回是否需要上传, 同时更新影子值和统计
+  bool shadowChanged(GLint location, const void *value, size_t size) const;
+
+  static uint32_t hashName(const char *name, size_t length)
+  {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++)
+      hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+    return hash;
+  }
+  // 提交之后、finish之前的状态
+  bool finished;
+  bool fromBinary;
+  unsigned int stages[3]; // 顶点/片段/几何着色器对象, 来自ShaderStageCache, finish时归还; 没有的阶段是0
+  std::string name;       // 日志里显示的名字
+  std::string binaryPath;
+  uint64_t binaryKey;
+  std::chrono::steady_clock::time_point submitTime;
+  double submitMs;
+
+  void compileProgram(const std::string &vertexCode, const std::string &fragmentCode, const std::string &geometryCode);
+
+  // 程序二进制缓存写在顶点着色器旁边, 文件名带上片段/几何着色器的名字, 同一个顶点着色器可以配不同的片段着色器
+  // 每个变体一个文件, 文件名里有定义的哈希
+  static std::string binaryCachePath(const char *vertexPath, const char *fragmentPath, const char *geometryPath, const ShaderDefines &defines);
+  // 展开后的源码(已经包含被包含的文件和定义)和驱动的厂商/渲染器/版本一起哈希, 换驱动后二进制自动失效
+  static uint64_t programKey(const std::string &vertexCode, const std::string &fragmentCode, const std::string &geometryCode);
+  // 驱动拒绝二进制(格式不认识、驱动升级)时返回false, 调用方从源码重新编译
+  bool loadProgramBinary(const std::string &path, uint64_t key);
+  bool saveProgramBinary(const std::string &path, uint64_t key) const;
+
+  void insertUniform(const std::string &name, GLint location);
+  // 把认识的uniform块(Frame/View/Lights/Object)连到UniformBuffers的固定绑定点
+  void bindUniformBlocks();
+  void buildUniformTable();
+
+  bool queryPositionOnly() const
+  {
+    GLint count = 0;
+    glGetProgramiv(ID, GL_ACTIVE_ATTRIBUTES, &count);
+    if (count != 1)
+      return false;
+    char name[256];
+    GLint size;
+    GLenum type;
+    glGetActiveAttrib(ID, 0, sizeof(name), nullptr, &size, &type, name);
+    return glGetAttribLocation(ID, name) == 0;
+  }
   void checkCompileErrors(unsigned int shader, std::string type)
   {
     int success;
@@ -166,4 +291,365 @@ private:
     }
   }
 };
+
+bool Shader::binaryCacheEnabled = true;
+bool Shader::uniformShadowEnabled = true;
+
+void Shader::submit(const GLchar* vertexPath, const GLchar* fragmentPath, const GLchar* geometryPath, const ShaderDefines &defines)
+{
+  submitTime = std::chrono::steady_clock::now();
+  finished = false;
+  name = std::string(vertexPath) + " + " + fragmentPath;
+  if (!defines.empty())
+    name += " [" + defines.key() + "]";
+  // 1. 读取顶点/片段着色器/几何着色器, 展开#include并插入变体的定义
+  // ----------------------------
+  std::string vertexCode;
+  std::string fragmentCode;
+  std::string geometryCode;
+  ShaderPreprocessor::load(vertexPath, defines, vertexCode);
+  ShaderPreprocessor::load(fragmentPath, defines, fragmentCode);
+  if (geometryPath != nullptr)
+    ShaderPreprocessor::load(geometryPath, defines, geometryCode);
+
+  // 2. 先尝试加载上次链接好的程序二进制, 失败时从源码编译
+  // ------------
+  stages[0] = stages[1] = stages[2] = 0;
+  binaryPath = binaryCachePath(vertexPath, fragmentPath, geometryPath, defines);
+  binaryKey = programKey(vertexCode, fragmentCode, geometryCode);
+  fromBinary = loadProgramBinary(binaryPath, binaryKey);
+  if (!fromBinary)
+    compileProgram(vertexCode, fragmentCode, geometryCode);
+  submitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - submitTime).count();
+}
+
+Shader::~Shader()
+{
+  if (!finished)
+    for (int i = 0; i < 3; i++)
+      if (stages[i] != 0)
+        ShaderStageCache::instance().release(stages[i]);
+  if (ID != 0)
+  {
+    GLState::instance().forgetProgram(ID);
+    glDeleteProgram(ID);
+  }
+}
+
+bool Shader::isReady() const
+{
+  if (finished)
+    return true;
+  if (!glCapabilities().parallelShaderCompile)
+    return false;
+  GLint done = GL_FALSE;
+  glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &done);
+  return done == GL_TRUE;
+}
+
+void Shader::finish()
+{
+  if (finished)
+    return;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  if (!fromBinary)
+  {
+    // 打印编译和连接错误(如果有的话), 这里的查询会等待驱动完成编译; 共享的阶段只报告一次
+    ShaderStageCache &stageCache = ShaderStageCache::instance();
+    const char *types[3] = { "VERTEX", "FRAGMENT", "GEOMETRY" };
+    for (int i = 0; i < 3; i++)
+      if (stages[i] != 0 && stageCache.markChecked(stages[i]))
+        checkCompileErrors(stages[i], types[i]);
+    checkCompileErrors(ID, "PROGRAM");
+    // 着色器已经链接到程序中了, 分离之后归还给缓存, 其他程序还可以继续链接
+    for (int i = 0; i < 3; i++)
+      if (stages[i] != 0)
+      {
+        glDetachShader(ID, stages[i]);
+        stageCache.release(stages[i]);
+      }
+    stages[0] = stages[1] = stages[2] = 0;
+    saveProgramBinary(binaryPath, binaryKey);
+  }
+  positionOnly = queryPositionOnly();
+  buildUniformTable();
+  bindUniformBlocks();
+  finished = true;
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+  if (Diagnostics::verboseLoading)
+  {
+    std::ostringstream line;
+    line << std::fixed << std::setprecision(1) << "SHADER::PROGRAM::" << name << (fromBinary ? " BINARY" : " SOURCE") << ", submit " << submitMs
+         << " ms, wait " << std::chrono::duration<double, std::milli>(end - start).count() << " ms, ready after "
+         << std::chrono::duration<double, std::milli>(end - submitTime).count() << " ms";
+    std::cout << line.str() << std::endl;
+  }
+}
+
+void Shader::compileProgram(const std::string &vertexCode, const std::string &fragmentCode, const std::string &geometryCode)
+{
+  // 这里只提交, 不查询编译状态; 支持并行编译的驱动在后台线程里编译链接
+  // 同样的阶段源码已经编译过时直接复用着色器对象
+  const std::string *codes[3] = { &vertexCode, &fragmentCode, &geometryCode };
+  const GLenum types[3] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, GL_GEOMETRY_SHADER };
+  for (int i = 0; i < 3; i++)
+  {
+    // 几何着色器是可选的
+    if (i == 2 && geometryCode.empty())
+      continue;
+    stages[i] = ShaderStageCache::instance().acquire(types[i], *codes[i]);
+  }
+  // 着色器程序
+  ID = glCreateProgram();
+  // 告诉驱动之后要取出二进制, 有的驱动不设置就不保留
+  if (binaryCacheEnabled && glCapabilities().programBinary)
+    glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  for (int i = 0; i < 3; i++)
+    if (stages[i] != 0)
+      glAttachShader(ID, stages[i]);
+  glLinkProgram(ID);
+}
+
+std::string Shader::binaryCachePath(const char *vertexPath, const char *fragmentPath, const char *geometryPath, const ShaderDefines &defines)
+{
+  std::string path(vertexPath);
+  const char *names[2] = { fragmentPath, geometryPath };
+  for (int i = 0; i < 2; i++)
+  {
+    if (names[i] == nullptr)
+      continue;
+    const char *slash = strrchr(names[i], '/');
+    path += ".";
+    path += slash ? slash + 1 : names[i];
+  }
+  if (!defines.empty())
+  {
+    std::string key = defines.key();
+    char hex[20];
+    snprintf(hex, sizeof(hex), ".%016llx", (unsigned long long)hashBytes(key.data(), key.size()));
+    path += hex;
+  }
+  return path + ".program";
+}
+
+uint64_t Shader::programKey(const std::string &vertexCode, const std::string &fragmentCode, const std::string &geometryCode)
+{
+  // 每段的长度也参与哈希, 避免内容在阶段之间挪动时得到同样的结果
+  uint64_t key = PROGRAM_BINARY_VERSION;
+  const std::string *stages[3] = { &vertexCode, &fragmentCode, &geometryCode };
+  for (int i = 0; i < 3; i++)
+    key = hashBytes(stages[i]->data(), stages[i]->size(), key ^ stages[i]->size());
+  const GLenum strings[3] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+  for (int i = 0; i < 3; i++)
+  {
+    const char *value = (const char *)glGetString(strings[i]);
+    if (value)
+      key = hashBytes(value, strlen(value), key);
+  }
+  return key;
+}
+
+bool Shader::loadProgramBinary(const std::string &path, uint64_t key)
+{
+  if (!binaryCacheEnabled || !glCapabilities().programBinary)
+    return false;
+  MappedFile file;
+  if (!file.open(path) || file.size() < sizeof(ProgramBinaryHeader))
+    return false;
+  const ProgramBinaryHeader *header = (const ProgramBinaryHeader *)file.data();
+  if (memcmp(header->magic, "GLPROGRM", 8) != 0 || header->version != PROGRAM_BINARY_VERSION || header->key != key ||
+      header->binarySize == 0 || header->binarySize > file.size() - sizeof(ProgramBinaryHeader))
+    return false;
+
+  ID = glCreateProgram();
+  glProgramBinary(ID, header->binaryFormat, file.data() + sizeof(ProgramBinaryHeader), (GLsizei)header->binarySize);
+  GLint success = 0;
+  glGetProgramiv(ID, GL_LINK_STATUS, &success);
+  if (!success)
+  {
+    // 驱动升级后版本字符串可能没变, 但二进制已经不能用了; 这里不报错, 重新编译后会覆盖这个文件
+    std::cout << "WARNING::SHADER::program binary rejected, recompiling " << path << std::endl;
+    GLState::instance().forgetProgram(ID);
+    glDeleteProgram(ID);
+    ID = 0;
+    return false;
+  }
+  return true;
+}
+
+bool Shader::saveProgramBinary(const std::string &path, uint64_t key) const
+{
+  if (!binaryCacheEnabled || !glCapabilities().programBinary)
+    return false;
+  GLint success = 0, length = 0;
+  glGetProgramiv(ID, GL_LINK_STATUS, &success);
+  glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (!success || length <= 0)
+    return false;
+  std::vector<unsigned char> binary((size_t)length);
+  GLenum format = 0;
+  GLsizei written = 0;
+  glGetProgramBinary(ID, length, &written, &format, &binary[0]);
+  if (written <= 0)
+    return false;
+
+  ProgramBinaryHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "GLPROGRM", 8);
+  header.version = PROGRAM_BINARY_VERSION;
+  header.binaryFormat = format;
+  header.key = key;
+  header.binarySize = (uint64_t)written;
+
+  // 先写临时文件再改名, 避免读到写了一半的文件
+  std::string tmpPath = path + ".tmp";
+  FILE *out = fopen(tmpPath.c_str(), "wb");
+  if (!out)
+    return false;
+  bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+  ok = ok && fwrite(&binary[0], 1, (size_t)written, out) == (size_t)written;
+  ok = fclose(out) == 0 && ok;
+  if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0)
+  {
+    remove(tmpPath.c_str());
+    std::cout << "WARNING::SHADER::failed to write program binary " << path << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool Shader::shadowChanged(GLint location, const void *value, size_t size) const
+{
+  // -1的设置GL本来就会忽略
+  if (location < 0)
+    return false;
+  UniformStats &stats = UniformStats::current();
+  if (uniformShadowEnabled && (size_t)location < shadows.size())
+  {
+    UniformShadow &shadow = shadows[location];
+    if (shadow.valid && memcmp(shadow.data, value, size) == 0)
+    {
+      stats.skipped++;
+      return false;
+    }
+    memcpy(shadow.data, value, size);
+    shadow.valid = true;
+  }
+  stats.uploads++;
+  return true;
+}
+
+GLint Shader::uniformLocation(const char *name)
+{
+  if (!finished)
+    finish();
+  UniformStats::current().lookups++;
+  size_t length = strlen(name);
+  if (!uniformSlots.empty())
+  {
+    uint32_t hash = hashName(name, length);
+    size_t mask = uniformSlots.size() - 1;
+    for (size_t slot = hash & mask; uniformSlots[slot].nameLength != 0; slot = (slot + 1) & mask)
+    {
+      const UniformSlot &entry = uniformSlots[slot];
+      if (entry.hash == hash && entry.nameLength == length && memcmp(uniformNames.data() + entry.nameOffset, name, length) == 0)
+        return entry.location;
+    }
+  }
+  UniformStats::current().misses++;
+  return -1;
+}
+
+unsigned int Shader::uniformId(const std::string &name)
+{
+  std::vector<std::string> &names = registeredNames();
+  std::vector<std::string>::iterator it = std::find(names.begin(), names.end(), name);
+  if (it != names.end())
+    return (unsigned int)(it - names.begin());
+  names.push_back(name);
+  return (unsigned int)names.size() - 1;
+}
+
+void Shader::bindUniformBlocks()
+{
+  GLint count = 0;
+  glGetProgramiv(ID, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+  char name[256];
+  for (GLint i = 0; i < count; i++)
+  {
+    glGetActiveUniformBlockName(ID, (GLuint)i, sizeof(name), nullptr, name);
+    int binding = uniformBlockBinding(name);
+    if (binding >= 0)
+      glUniformBlockBinding(ID, (GLuint)i, (GLuint)binding);
+    else
+      std::cout << "WARNING::SHADER::unknown uniform block " << name << " in " << this->name << std::endl;
+  }
+}
+
+void Shader::insertUniform(const std::string &name, GLint location)
+{
+  uint32_t hash = hashName(name.data(), name.size());
+  size_t mask = uniformSlots.size() - 1;
+  size_t slot = hash & mask;
+  while (uniformSlots[slot].nameLength != 0)
+    slot = (slot + 1) & mask;
+  UniformSlot entry = { hash, location, (uint32_t)uniformNames.size(), (uint32_t)name.size() };
+  uniformSlots[slot] = entry;
+  uniformNames += name;
+}
+
+void Shader::buildUniformTable()
+{
+  // 数组uniform只报告一次(name[0], size为元素个数), 每个元素和不带下标的名字都登记一遍
+  registeredLocations.clear();
+  GLint count = 0;
+  glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+  std::vector<std::string> names;
+  std::vector<GLint> locations;
+  char name[256];
+  for (GLint i = 0; i < count; i++)
+  {
+    GLint size;
+    GLenum type;
+    glGetActiveUniform(ID, (GLuint)i, sizeof(name), nullptr, &size, &type, name);
+    std::string base(name);
+    bool isArray = base.size() > 3 && base.compare(base.size() - 3, 3, "[0]") == 0;
+    if (isArray)
+      base.resize(base.size() - 3);
+    for (GLint element = 0; element < (isArray ? size : 1); element++)
+    {
+      std::string full = isArray ? base + "[" + std::to_string(element) + "]" : base;
+      GLint location = glGetUniformLocation(ID, full.c_str());
+      UniformStats::current().locationQueries++;
+      // uniform块里的成员没有位置
+      if (location < 0)
+        continue;
+      names.push_back(full);
+      locations.push_back(location);
+      if (isArray && element == 0)
+      {
+        names.push_back(base);
+        locations.push_back(location);
+      }
+    }
+  }
+
+  size_t capacity = 16;
+  while (capacity < names.size() * 2)
+    capacity *= 2;
+  UniformSlot empty = { 0, -1, 0, 0 };
+  uniformSlots.assign(capacity, empty);
+  uniformNames.clear();
+  GLint maxLocation = -1;
+  for (size_t i = 0; i < names.size(); i++)
+  {
+    insertUniform(names[i], locations[i]);
+    maxLocation = std::max(maxLocation, locations[i]);
+  }
+
+  // 重新链接后uniform都回到初始值, 影子值全部作废
+  UniformShadow invalid;
+  memset(&invalid, 0, sizeof(invalid));
+  shadows.assign(maxLocation < MAX_SHADOW_LOCATION ? (size_t)(maxLocation + 1) : (size_t)MAX_SHADOW_LOCATION, invalid);
+}
 #endif
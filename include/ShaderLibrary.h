@@ -0,0 +1,127 @@
+#ifndef SHADER_LIBRARY_H
+#define SHADER_LIBRARY_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <iostream>
+
+#include <Shader.h>
+#include <ShaderPreprocessor.h>
+
+// 按名字管理着色器程序: 启动时把所有程序一次提交, 驱动编译的同时主线程继续加载资源,
+// 程序第一次get或者use时才等待结果; 支持KHR_parallel_shader_compile时编译在驱动的线程里并行进行,
+// 不支持时驱动通常在第一次查询状态时才真正编译, 也能和资源加载错开
+// 同一组源文件可以按不同的ShaderDefines编出多个变体, 只编译实际请求过的变体
+class ShaderLibrary
+{
+private:
+  struct Program
+  {
+    std::string vertexPath;
+    std::string fragmentPath;
+    std::string geometryPath; // 为空表示没有几何着色器
+    // 变体的键(ShaderDefines::key) -> 程序, 空键是没有定义的默认变体; Shader的地址在返回引用之后不能变
+    std::map<std::string, std::unique_ptr<Shader> > variants;
+  };
+  std::map<std::string, Program> programs;
+
+  ShaderLibrary() {}
+  ShaderLibrary(const ShaderLibrary &) = delete;
+  ShaderLibrary &operator=(const ShaderLibrary &) = delete;
+public:
+  static ShaderLibrary &instance()
+  {
+    static ShaderLibrary library;
+    return library;
+  }
+
+  // 只登记源文件, 不编译; 已经提交过变体的名字不能再换源文件, 否则之前返回的Shader引用会悬空
+  void declare(const std::string &name, const char *vertexPath, const char *fragmentPath, const char *geometryPath = nullptr);
+  // 登记并提交默认变体
+  Shader &add(const std::string &name, const char *vertexPath, const char *fragmentPath, const char *geometryPath = nullptr);
+  // 提交一个变体的编译, 不等待; 已经提交过时直接返回
+  Shader &request(const std::string &name, const ShaderDefines &defines = ShaderDefines());
+  // 返回编译链接完成的变体, 没有提交过时在这里提交, 还没完成时在这里等待
+  Shader &get(const std::string &name, const ShaderDefines &defines = ShaderDefines());
+  // 不阻塞地收尾已经完成的程序(检查错误、建立uniform表), 返回还在编译的数量; 可以在加载资源的间隙调用
+  unsigned int poll();
+  // 等待所有程序完成
+  void finishAll();
+  // 删除所有程序, 之前返回的引用全部失效; 在GL上下文销毁之前调用
+  void clear() { programs.clear(); }
+};
+
+void ShaderLibrary::declare(const std::string &name, const char *vertexPath, const char *fragmentPath, const char *geometryPath)
+{
+  Program &program = programs[name];
+  if (!program.variants.empty())
+  {
+    // 相同的源文件重复登记时什么也不做
+    if (program.vertexPath != vertexPath || program.fragmentPath != fragmentPath || program.geometryPath != (geometryPath ? geometryPath : ""))
+      std::cout << "ERROR::SHADER_LIBRARY::program " << name << " already has variants, keeping its sources" << std::endl;
+    return;
+  }
+  program.vertexPath = vertexPath;
+  program.fragmentPath = fragmentPath;
+  program.geometryPath = geometryPath ? geometryPath : "";
+}
+
+Shader &ShaderLibrary::add(const std::string &name, const char *vertexPath, const char *fragmentPath, const char *geometryPath)
+{
+  declare(name, vertexPath, fragmentPath, geometryPath);
+  return request(name);
+}
+
+Shader &ShaderLibrary::request(const std::string &name, const ShaderDefines &defines)
+{
+  std::map<std::string, Program>::iterator it = programs.find(name);
+  if (it == programs.end())
+  {
+    // 返回一个空程序, use之后的绘制什么也不输出, 和链接失败时一样
+    std::cout << "ERROR::SHADER_LIBRARY::unknown program " << name << std::endl;
+    static Shader missing;
+    return missing;
+  }
+  Program &program = it->second;
+  std::unique_ptr<Shader> &shader = program.variants[defines.key()];
+  if (!shader)
+  {
+    shader.reset(new Shader());
+    shader->submit(program.vertexPath.c_str(), program.fragmentPath.c_str(),
+                   program.geometryPath.empty() ? nullptr : program.geometryPath.c_str(), defines);
+  }
+  return *shader;
+}
+
+Shader &ShaderLibrary::get(const std::string &name, const ShaderDefines &defines)
+{
+  Shader &shader = request(name, defines);
+  shader.finish();
+  return shader;
+}
+
+unsigned int ShaderLibrary::poll()
+{
+  unsigned int pending = 0;
+  for (std::map<std::string, Program>::iterator it = programs.begin(); it != programs.end(); ++it)
+    for (std::map<std::string, std::unique_ptr<Shader> >::iterator v = it->second.variants.begin(); v != it->second.variants.end(); ++v)
+    {
+      if (v->second->isFinished())
+        continue;
+      if (v->second->isReady())
+        v->second->finish();
+      else
+        pending++;
+    }
+  return pending;
+}
+
+void ShaderLibrary::finishAll()
+{
+  for (std::map<std::string, Program>::iterator it = programs.begin(); it != programs.end(); ++it)
+    for (std::map<std::string, std::unique_ptr<Shader> >::iterator v = it->second.variants.begin(); v != it->second.variants.end(); ++v)
+      v->second->finish();
+}
+
+#endif
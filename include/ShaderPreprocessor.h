@@ -0,0 +1,195 @@
+#ifndef SHADER_PREPROCESSOR_H
+#define SHADER_PREPROCESSOR_H
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+
+// 一个着色器变体的编译期常量, 按名字排序, 同样的一组定义总是得到同样的键
+// 着色器里用#ifndef NAME给出默认值, 变体的定义插在它前面, 覆盖默认值; 灯光数量这类常量让编译器可以展开循环
+class ShaderDefines
+{
+private:
+  std::vector<std::pair<std::string, std::string> > values;
+public:
+  // 同名的定义会被覆盖
+  ShaderDefines &set(const std::string &name, const std::string &value = "1")
+  {
+    std::vector<std::pair<std::string, std::string> >::iterator it = values.begin();
+    while (it != values.end() && it->first < name)
+      ++it;
+    if (it != values.end() && it->first == name)
+      it->second = value;
+    else
+      values.insert(it, std::make_pair(name, value));
+    return *this;
+  }
+  ShaderDefines &set(const std::string &name, int value) { return set(name, std::to_string(value)); }
+
+  bool empty() const { return values.empty(); }
+  // 插入到#version之后的源码
+  std::string source() const
+  {
+    std::string result;
+    for (size_t i = 0; i < values.size(); i++)
+      result += "#define " + values[i].first + " " + values[i].second + "\n";
+    return result;
+  }
+  // 变体的键, 比如"NR_LIGHTS=4;USE_SHADOWS=1"
+  std::string key() const
+  {
+    std::string result;
+    for (size_t i = 0; i < values.size(); i++)
+      result += (i ? ";" : "") + values[i].first + "=" + values[i].second;
+    return result;
+  }
+};
+
+// 着色器源码的预处理: 展开#include "file"(相对于当前文件的目录, 每个文件只展开一次), 在#version之后插入ShaderDefines
+// 展开处插入#line, 编译错误里的"N(行号)"中N是文件在展开顺序里的编号, 0是着色器本身
+class ShaderPreprocessor
+{
+private:
+  static bool readFile(const std::string &path, std::string &text);
+  static size_t directive(const std::string &line, const char *name);
+  static bool hasVersion(const std::string &text);
+  static bool expand(const std::string &path, const ShaderDefines *defines, unsigned int depth, std::vector<std::string> &files, std::string &out);
+public:
+  static const unsigned int MAX_INCLUDE_DEPTH = 16;
+
+  // 读取path并展开, 失败时打印错误并返回false
+  static bool load(const std::string &path, const ShaderDefines &defines, std::string &source);
+};
+
+bool ShaderPreprocessor::readFile(const std::string &path, std::string &text)
+{
+  std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+  if (!file)
+    return false;
+  std::stringstream stream;
+  stream << file.rdbuf();
+  text = stream.str();
+  return true;
+}
+
+// line是name指令时返回指令名之后的位置, 否则返回npos; 和GLSL一样'#'前后允许有空白, 比如"# version"
+size_t ShaderPreprocessor::directive(const std::string &line, const char *name)
+{
+  size_t p = line.find_first_not_of(" \t");
+  if (p == std::string::npos || line[p] != '#')
+    return std::string::npos;
+  p = line.find_first_not_of(" \t", p + 1);
+  size_t length = strlen(name);
+  if (p == std::string::npos || line.compare(p, length, name) != 0)
+    return std::string::npos;
+  return p + length;
+}
+
+bool ShaderPreprocessor::hasVersion(const std::string &text)
+{
+  for (size_t begin = 0; begin < text.size(); )
+  {
+    size_t end = text.find('\n', begin);
+    if (end == std::string::npos)
+      end = text.size();
+    if (directive(text.substr(begin, end - begin), "version") != std::string::npos)
+      return true;
+    begin = end + 1;
+  }
+  return false;
+}
+
+bool ShaderPreprocessor::load(const std::string &path, const ShaderDefines &defines, std::string &source)
+{
+  std::vector<std::string> files;
+  source.clear();
+  return expand(path, &defines, 0, files, source);
+}
+
+bool ShaderPreprocessor::expand(const std::string &path, const ShaderDefines *defines, unsigned int depth, std::vector<std::string> &files, std::string &out)
+{
+  std::string text;
+  if (!readFile(path, text))
+  {
+    std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ " << path << std::endl;
+    return false;
+  }
+  unsigned int fileIndex = (unsigned int)files.size();
+  files.push_back(path);
+  size_t slash = path.find_last_of('/');
+  std::string directory = slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+  // 没有#version的文件直接把定义放在最前面
+  bool versionSeen = defines == nullptr;
+  if (defines != nullptr && !hasVersion(text))
+  {
+    out += defines->source();
+    out += "#line 1 " + std::to_string(fileIndex) + "\n";
+    versionSeen = true;
+  }
+
+  unsigned int lineNumber = 0;
+  for (size_t begin = 0; begin < text.size(); )
+  {
+    size_t end = text.find('\n', begin);
+    if (end == std::string::npos)
+      end = text.size();
+    std::string line = text.substr(begin, end - begin);
+    begin = end + 1;
+    lineNumber++;
+
+    if (directive(line, "version") != std::string::npos)
+    {
+      // 被包含的文件里的#version忽略掉
+      if (defines == nullptr)
+      {
+        out += "\n";
+        continue;
+      }
+      out += line + "\n";
+      if (!versionSeen)
+      {
+        out += defines->source();
+        out += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileIndex) + "\n";
+        versionSeen = true;
+      }
+      continue;
+    }
+    size_t name = directive(line, "include");
+    if (name == std::string::npos)
+    {
+      out += line + "\n";
+      continue;
+    }
+
+    size_t open = line.find_first_of("\"<", name);
+    size_t close = open == std::string::npos ? std::string::npos : line.find_first_of("\">", open + 1);
+    if (close == std::string::npos)
+    {
+      std::cout << "ERROR::SHADER::PREPROCESSOR::" << path << "(" << lineNumber << "): malformed #include" << std::endl;
+      return false;
+    }
+    std::string includePath = directory + line.substr(open + 1, close - open - 1);
+    if (std::find(files.begin(), files.end(), includePath) != files.end())
+    {
+      out += "\n";
+      continue;
+    }
+    if (depth + 1 >= MAX_INCLUDE_DEPTH)
+    {
+      std::cout << "ERROR::SHADER::PREPROCESSOR::" << path << "(" << lineNumber << "): #include nested too deeply" << std::endl;
+      return false;
+    }
+    out += "#line 1 " + std::to_string(files.size()) + "\n";
+    if (!expand(includePath, nullptr, depth + 1, files, out))
+      return false;
+    out += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileIndex) + "\n";
+  }
+  return true;
+}
+
+#endif
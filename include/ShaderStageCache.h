@@ -0,0 +1,128 @@
+#ifndef SHADER_STAGE_CACHE_H
+#define SHADER_STAGE_CACHE_H
+
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <stdint.h>
+
+#include <glad/glad.h>
+
+#include <MappedFile.h>
+
+// 编译好的着色器对象按(阶段类型, 展开后的源码)共享, 同一个阶段只编译一次, 链接进所有用到它的程序
+// 比如cubemap.vs同时用于equirectangularToCubemap和irradiance, 各种全屏四边形的.vs也是同一份
+// 程序链接完成后只归还引用, 着色器对象留在缓存里给之后的程序用, 启动完成后调用trim释放没人用的
+class ShaderStageCache
+{
+private:
+  struct Stage
+  {
+    unsigned int id;
+    GLenum type;
+    size_t length;    // 源码长度, 和哈希一起比较, 进一步避免碰撞
+    unsigned int refs; // 还没链接完成的程序个数
+    bool checked;      // 编译错误已经检查(打印)过了
+  };
+  std::unordered_map<uint64_t, Stage> stages;
+  // 着色器对象 -> 键
+  std::unordered_map<unsigned int, uint64_t> keys;
+  unsigned int compiled;
+  unsigned int reused;
+
+  ShaderStageCache() : compiled(0), reused(0) {}
+  ShaderStageCache(const ShaderStageCache &) = delete;
+  ShaderStageCache &operator=(const ShaderStageCache &) = delete;
+
+  static uint64_t stageKey(GLenum type, const std::string &source) { return hashBytes(source.data(), source.size(), 0x9E3779B97F4A7C15ULL ^ type); }
+public:
+  static ShaderStageCache &instance()
+  {
+    static ShaderStageCache cache;
+    return cache;
+  }
+
+  // 返回编译过(或者刚提交编译)的着色器对象, 引用加一; 不查询编译状态
+  unsigned int acquire(GLenum type, const std::string &source);
+  // 程序链接完成后归还
+  void release(unsigned int id);
+  // 第一次调用时返回true, 调用方检查并打印编译错误, 共享的阶段只报告一次
+  bool markChecked(unsigned int id);
+  // 删除没有程序在用的着色器对象
+  void trim();
+  void printReport() const;
+};
+
+unsigned int ShaderStageCache::acquire(GLenum type, const std::string &source)
+{
+  uint64_t key = stageKey(type, source);
+  std::unordered_map<uint64_t, Stage>::iterator it = stages.find(key);
+  if (it != stages.end() && it->second.type == type && it->second.length == source.size())
+  {
+    it->second.refs++;
+    reused++;
+    return it->second.id;
+  }
+  // 哈希碰撞时不进缓存, 单独编译, 归还时直接删除
+  bool cacheable = it == stages.end();
+
+  unsigned int id = glCreateShader(type);
+  const char *code = source.c_str();
+  // 第二个参数是源代码字符串数量
+  glShaderSource(id, 1, &code, NULL);
+  glCompileShader(id);
+  compiled++;
+  Stage stage = { id, type, source.size(), 1, false };
+  if (cacheable)
+  {
+    stages[key] = stage;
+    keys[id] = key;
+  }
+  return id;
+}
+
+void ShaderStageCache::release(unsigned int id)
+{
+  std::unordered_map<unsigned int, uint64_t>::iterator it = keys.find(id);
+  if (it == keys.end())
+  {
+    glDeleteShader(id);
+    return;
+  }
+  Stage &stage = stages[it->second];
+  if (stage.refs > 0)
+    stage.refs--;
+}
+
+bool ShaderStageCache::markChecked(unsigned int id)
+{
+  std::unordered_map<unsigned int, uint64_t>::iterator it = keys.find(id);
+  if (it == keys.end())
+    return true;
+  Stage &stage = stages[it->second];
+  bool first = !stage.checked;
+  stage.checked = true;
+  return first;
+}
+
+void ShaderStageCache::trim()
+{
+  for (std::unordered_map<uint64_t, Stage>::iterator it = stages.begin(); it != stages.end(); )
+  {
+    if (it->second.refs == 0)
+    {
+      glDeleteShader(it->second.id);
+      keys.erase(it->second.id);
+      it = stages.erase(it);
+    }
+    else
+      ++it;
+  }
+}
+
+void ShaderStageCache::printReport() const
+{
+  std::cout << "SHADER::STAGES:: " << compiled << " compiled, " << reused << " reused, " << stages.size() << " cached" << std::endl;
+}
+
+#endif
@@ -0,0 +1,387 @@
+#ifndef STAGING_UPLOADER_H
+#define STAGING_UPLOADER_H
+
+#include <vector>
+#include <cstring>
+#include <iostream>
+
+#include <glad/glad.h>
+
+#include <GLExtensions.h>
+#include <GLDirectState.h>
+
+// 一次暂存分配, data是映射好的地址, 在submit之前可以在任何线程里写入
+struct StagingAllocation
+{
+  unsigned int block;
+  void *data;
+  size_t size;
+};
+
+// 暂存块里一级纹理数据的位置
+struct StagingTextureLevel
+{
+  GLsizei width;
+  GLsizei height;
+  size_t offset;
+  size_t size;
+};
+
+// 每帧的上传统计
+struct StagingStats
+{
+  size_t bytes;          // 通过暂存区上传的字节数
+  unsigned int uploads;  // 上传次数
+  unsigned int stalls;   // 没有空闲块, 只能等fence的次数
+  unsigned int deferred; // 非阻塞分配失败、推迟到下一帧的次数
+};
+
+// 暂存上传器: 一圈PBO块, 工作线程直接往映射的内存里写, GL再从缓冲区拷贝到纹理/顶点缓冲,
+// 每个块提交后插入fence, fence完成后块才会被再次使用, 所以写入永远不会和GPU读取冲突
+// 为单次大上传扩容的块和长时间没用过的块在endFrame里释放存储, 启动时的大贴图不会一直占着暂存内存
+// 有GL 4.4/ARB_buffer_storage时块是持久映射的; 否则每次分配时用glMapBufferRange映射, 提交时解除映射
+class StagingUploader
+{
+private:
+  enum BlockState { BLOCK_FREE, BLOCK_FILLING, BLOCK_IN_FLIGHT };
+  struct Block
+  {
+    unsigned int buffer;
+    size_t capacity;
+    void *mapped;
+    GLsync fence;
+    BlockState state;
+    unsigned int idleFrames; // 连续空闲的帧数
+  };
+
+  std::vector<Block> blocks;
+  size_t blockSize;
+  unsigned int maxBlocks;
+  bool persistent;
+  bool enabled;
+  StagingStats current;
+  StagingStats last;
+
+  StagingUploader() : blockSize(0), maxBlocks(0), persistent(false), enabled(false)
+  {
+    memset(&current, 0, sizeof(current));
+    memset(&last, 0, sizeof(last));
+  }
+  StagingUploader(const StagingUploader &) = delete;
+  StagingUploader &operator=(const StagingUploader &) = delete;
+
+  void createStorage(Block &block, size_t capacity);
+  void releaseStorage(Block &block);
+  void trim();
+  void recycle(bool wait);
+  void *mapBlock(Block &block, size_t size);
+  void finishSubmit(Block &block, size_t size);
+public:
+  // 空闲块连续这么多帧没有用过就释放存储
+  static const unsigned int TRIM_IDLE_FRAMES = 300;
+
+  static StagingUploader &instance()
+  {
+    static StagingUploader uploader;
+    return uploader;
+  }
+
+  // 在GL线程、loadGLExtensions之后调用; 不调用时所有上传都走原来的同步路径
+  void init(size_t blockBytes = 16 * 1024 * 1024, unsigned int blockCount = 8);
+  bool isEnabled() const { return enabled; }
+  bool isPersistent() const { return persistent; }
+
+  // 分配一个至少size字节的块; wait为false且没有空闲块时返回false, 否则等最早提交的块
+  bool allocate(size_t size, StagingAllocation &allocation, bool wait = true);
+  // 写好的数据按levels描述的位置逐级拷贝进纹理, 之后块交还给环; type为0表示internalFormat是压缩格式
+  void submitTexture2D(const StagingAllocation &allocation, unsigned int texture, GLint internalFormat, GLenum format, GLenum type, const StagingTextureLevel *levels, unsigned int levelCount);
+  // 写好的数据拷贝进dstBuffer的dstOffset处
+  void submitBuffer(const StagingAllocation &allocation, unsigned int dstBuffer, size_t dstOffset);
+  // 分配了但不再需要, 直接把块还回去
+  void discard(const StagingAllocation &allocation);
+
+  // 代替glBufferData, 不需要事先绑定缓冲区; 数据在当前线程拷进暂存区后由GL拷贝
+  void bufferData(unsigned int buffer, const void *data, size_t size, GLenum usage);
+  // 代替glBufferSubData, 不需要事先绑定缓冲区
+  void bufferSubData(unsigned int buffer, size_t offset, const void *data, size_t size);
+  // 代替glTexImage2D(GL_TEXTURE_2D, ...), 用法同上; 有直接访问时分配只有一级的不可变存储, 每个纹理只能调用一次
+  void texImage2D(unsigned int texture, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLenum format, GLenum type, const void *data, size_t size);
+
+  // 每帧结束时调用, 回收已经完成的块, 释放超过blockSize或者长时间空闲的块, 并统计这一帧的数据
+  void endFrame();
+  const StagingStats &lastFrame() const { return last; }
+};
+
+void StagingUploader::init(size_t blockBytes, unsigned int blockCount)
+{
+  blockSize = blockBytes;
+  maxBlocks = blockCount;
+  persistent = glCapabilities().bufferStorage;
+  enabled = true;
+}
+
+void StagingUploader::createStorage(Block &block, size_t capacity)
+{
+  if (block.buffer != 0 && persistent)
+  {
+    // 持久映射的存储不能改大小, 只能重新创建
+    unmapNamedBuffer(block.buffer);
+    glDeleteBuffers(1, &block.buffer);
+    block.buffer = 0;
+  }
+  if (block.buffer == 0)
+    block.buffer = createBufferObject();
+  if (persistent)
+  {
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    namedBufferStorage(block.buffer, capacity, nullptr, flags);
+    block.mapped = mapNamedBufferRange(block.buffer, 0, capacity, flags);
+  }
+  else
+  {
+    namedBufferData(block.buffer, capacity, nullptr, GL_STREAM_DRAW);
+    block.mapped = nullptr;
+  }
+  block.capacity = capacity;
+}
+
+void StagingUploader::releaseStorage(Block &block)
+{
+  if (block.buffer == 0)
+    return;
+  if (persistent)
+    unmapNamedBuffer(block.buffer);
+  glDeleteBuffers(1, &block.buffer);
+  block.buffer = 0;
+  block.mapped = nullptr;
+  block.capacity = 0;
+}
+
+void StagingUploader::trim()
+{
+  // 只动fence已经完成的空闲块, 下次分配时按需要重新创建
+  for (unsigned int i = 0; i < blocks.size(); i++)
+  {
+    Block &block = blocks[i];
+    if (block.state != BLOCK_FREE || block.buffer == 0)
+      continue;
+    block.idleFrames++;
+    if (block.capacity > blockSize || block.idleFrames >= TRIM_IDLE_FRAMES)
+      releaseStorage(block);
+  }
+}
+
+void StagingUploader::recycle(bool wait)
+{
+  // 回收fence已经完成的块; wait为true时至少等到最早提交的那个块完成
+  int oldest = -1;
+  for (unsigned int i = 0; i < blocks.size(); i++)
+  {
+    Block &block = blocks[i];
+    if (block.state != BLOCK_IN_FLIGHT)
+      continue;
+    GLenum status = glClientWaitSync(block.fence, 0, 0);
+    if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+    {
+      glDeleteSync(block.fence);
+      block.fence = 0;
+      block.state = BLOCK_FREE;
+      wait = false;
+    }
+    else if (oldest < 0)
+      oldest = (int)i;
+  }
+  if (wait && oldest >= 0)
+  {
+    current.stalls++;
+    Block &block = blocks[oldest];
+    // 超时就继续等, 只有真正完成才能复用; 等待失败时块留在飞行中, 由调用方按没有空闲块处理
+    GLenum status = glClientWaitSync(block.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ULL);
+    while (status == GL_TIMEOUT_EXPIRED)
+      status = glClientWaitSync(block.fence, 0, 1000000000ULL);
+    if (status == GL_WAIT_FAILED)
+      return;
+    glDeleteSync(block.fence);
+    block.fence = 0;
+    block.state = BLOCK_FREE;
+  }
+}
+
+void *StagingUploader::mapBlock(Block &block, size_t size)
+{
+  if (persistent)
+    return block.mapped;
+  // fence已经保证GPU不再读这个块, 可以不同步地映射
+  return mapNamedBufferRange(block.buffer, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+}
+
+bool StagingUploader::allocate(size_t size, StagingAllocation &allocation, bool wait)
+{
+  recycle(false);
+  for (int attempt = 0; attempt < 2; attempt++)
+  {
+    // 优先用容量足够的空闲块, 其次是可以扩容的空闲块, 最后才新建
+    int candidate = -1;
+    for (unsigned int i = 0; i < blocks.size(); i++)
+    {
+      if (blocks[i].state != BLOCK_FREE)
+        continue;
+      if (blocks[i].capacity >= size)
+      {
+        candidate = (int)i;
+        break;
+      }
+      if (candidate < 0)
+        candidate = (int)i;
+    }
+    if (candidate < 0 && blocks.size() < maxBlocks)
+    {
+      Block block;
+      block.buffer = 0;
+      block.capacity = 0;
+      block.mapped = nullptr;
+      block.fence = 0;
+      block.state = BLOCK_FREE;
+      block.idleFrames = 0;
+      blocks.push_back(block);
+      candidate = (int)blocks.size() - 1;
+    }
+    if (candidate >= 0)
+    {
+      Block &block = blocks[candidate];
+      if (block.capacity < size)
+        createStorage(block, size > blockSize ? size : blockSize);
+      allocation.block = (unsigned int)candidate;
+      allocation.size = size;
+      allocation.data = mapBlock(block, size);
+      if (!allocation.data)
+        return false;
+      block.state = BLOCK_FILLING;
+      block.idleFrames = 0;
+      return true;
+    }
+    if (!wait)
+    {
+      current.deferred++;
+      return false;
+    }
+    recycle(true);
+  }
+  return false;
+}
+
+void StagingUploader::finishSubmit(Block &block, size_t size)
+{
+  block.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  block.state = BLOCK_IN_FLIGHT;
+  current.bytes += size;
+  current.uploads++;
+}
+
+void StagingUploader::submitTexture2D(const StagingAllocation &allocation, unsigned int texture, GLint internalFormat, GLenum format, GLenum type, const StagingTextureLevel *levels, unsigned int levelCount)
+{
+  Block &block = blocks[allocation.block];
+  if (!persistent)
+    unmapNamedBuffer(block.buffer);
+  // 纹理没有按名字从缓冲区读数据的函数, PIXEL_UNPACK_BUFFER总是要绑定; 绑定之后最后一个参数是缓冲区内的偏移
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, block.buffer);
+  if (glCapabilities().directStateAccess)
+  {
+    // 整条mip链一次分配成不可变存储, 再逐级写入
+    textureStorage(texture, GL_TEXTURE_2D, levelCount, internalFormat, levels[0].width, levels[0].height, format, type);
+    for (unsigned int i = 0; i < levelCount; i++)
+    {
+      if (type == 0)
+        glCompressedTextureSubImage2D(texture, i, 0, 0, levels[i].width, levels[i].height, internalFormat, (GLsizei)levels[i].size, (void *)levels[i].offset);
+      else
+        glTextureSubImage2D(texture, i, 0, 0, levels[i].width, levels[i].height, format, type, (void *)levels[i].offset);
+    }
+  }
+  else
+  {
+    GLState::instance().bindTexture(GL_TEXTURE_2D, texture);
+    for (unsigned int i = 0; i < levelCount; i++)
+    {
+      if (type == 0)
+        glCompressedTexImage2D(GL_TEXTURE_2D, i, internalFormat, levels[i].width, levels[i].height, 0, (GLsizei)levels[i].size, (void *)levels[i].offset);
+      else
+        glTexImage2D(GL_TEXTURE_2D, i, internalFormat, levels[i].width, levels[i].height, 0, format, type, (void *)levels[i].offset);
+    }
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  finishSubmit(block, allocation.size);
+}
+
+void StagingUploader::submitBuffer(const StagingAllocation &allocation, unsigned int dstBuffer, size_t dstOffset)
+{
+  Block &block = blocks[allocation.block];
+  if (!persistent)
+    unmapNamedBuffer(block.buffer);
+  copyNamedBufferSubData(block.buffer, dstBuffer, 0, dstOffset, allocation.size);
+  finishSubmit(block, allocation.size);
+}
+
+void StagingUploader::discard(const StagingAllocation &allocation)
+{
+  Block &block = blocks[allocation.block];
+  if (!persistent)
+    unmapNamedBuffer(block.buffer);
+  block.state = BLOCK_FREE;
+}
+
+void StagingUploader::bufferData(unsigned int buffer, const void *data, size_t size, GLenum usage)
+{
+  StagingAllocation allocation;
+  if (!enabled || size == 0 || !allocate(size, allocation))
+  {
+    namedBufferData(buffer, size, data, usage);
+    return;
+  }
+  namedBufferData(buffer, size, nullptr, usage);
+  memcpy(allocation.data, data, size);
+  submitBuffer(allocation, buffer, 0);
+}
+
+void StagingUploader::bufferSubData(unsigned int buffer, size_t offset, const void *data, size_t size)
+{
+  if (size == 0)
+    return;
+  StagingAllocation allocation;
+  if (!enabled || !allocate(size, allocation))
+  {
+    namedBufferSubData(buffer, offset, size, data);
+    return;
+  }
+  memcpy(allocation.data, data, size);
+  submitBuffer(allocation, buffer, offset);
+}
+
+void StagingUploader::texImage2D(unsigned int texture, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLenum format, GLenum type, const void *data, size_t size)
+{
+  StagingAllocation allocation;
+  if (!enabled || size == 0 || !allocate(size, allocation))
+  {
+    if (glCapabilities().directStateAccess)
+    {
+      textureStorage(texture, GL_TEXTURE_2D, 1, internalFormat, width, height, format, type);
+      glTextureSubImage2D(texture, 0, 0, 0, width, height, format, type, data);
+      return;
+    }
+    GLState::instance().bindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, level, internalFormat, width, height, 0, format, type, data);
+    return;
+  }
+  memcpy(allocation.data, data, size);
+  StagingTextureLevel mip = { width, height, 0, size };
+  submitTexture2D(allocation, texture, internalFormat, format, type, &mip, 1);
+}
+
+void StagingUploader::endFrame()
+{
+  recycle(false);
+  trim();
+  last = current;
+  memset(&current, 0, sizeof(current));
+}
+
+#endif
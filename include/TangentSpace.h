@@ -0,0 +1,79 @@
+#ifndef TANGENT_SPACE_H
+#define TANGENT_SPACE_H
+
+#include <cmath>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <VertexFormat.h>
+
+// 导入阶段生成切线, 只处理CPU数据, 可以在工作线程里调用
+// 和MikkTSpace的约定一致: 每个三角形按纹理坐标的梯度求切线和副切线, 按顶点处的角度加权累加,
+// 再对法线做Gram-Schmidt正交化; 副切线不存, 只存手性, 着色器里用cross(N, T) * w重建
+// 没有另外拆分顶点, 镜像UV的接缝在导出时本来就是不同的顶点
+class TangentSpace
+{
+private:
+  // 和n垂直的任意单位向量, 纹理坐标退化时使用
+  static glm::vec3 perpendicular(const glm::vec3 &n);
+public:
+  static void generate(std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices);
+};
+
+glm::vec3 TangentSpace::perpendicular(const glm::vec3 &n)
+{
+  glm::vec3 axis = std::fabs(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+  glm::vec3 t = glm::cross(n, axis);
+  float length = glm::length(t);
+  return length > 0.0f ? t / length : glm::vec3(1.0f, 0.0f, 0.0f);
+}
+
+void TangentSpace::generate(std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices)
+{
+  std::vector<glm::vec3> tangents(vertices.size(), glm::vec3(0.0f));
+  std::vector<glm::vec3> bitangents(vertices.size(), glm::vec3(0.0f));
+  for (size_t t = 0; t + 2 < indices.size(); t += 3)
+  {
+    const unsigned int *tri = &indices[t];
+    glm::vec3 e1 = vertices[tri[1]].Position - vertices[tri[0]].Position;
+    glm::vec3 e2 = vertices[tri[2]].Position - vertices[tri[0]].Position;
+    glm::vec2 d1 = vertices[tri[1]].TexCoords - vertices[tri[0]].TexCoords;
+    glm::vec2 d2 = vertices[tri[2]].TexCoords - vertices[tri[0]].TexCoords;
+    float det = d1.x * d2.y - d2.x * d1.y;
+    if (std::fabs(det) < 1e-12f)
+      continue;
+    // 只要方向, 长度在累加前归一化, 否则UV密度大的三角形会占主导
+    glm::vec3 tangent = (e1 * d2.y - e2 * d1.y) / det;
+    glm::vec3 bitangent = (e2 * d1.x - e1 * d2.x) / det;
+    float tangentLength = glm::length(tangent), bitangentLength = glm::length(bitangent);
+    if (tangentLength <= 0.0f || bitangentLength <= 0.0f)
+      continue;
+    tangent /= tangentLength;
+    bitangent /= bitangentLength;
+    for (int k = 0; k < 3; k++)
+    {
+      const glm::vec3 &p = vertices[tri[k]].Position;
+      glm::vec3 a = vertices[tri[(k + 1) % 3]].Position - p;
+      glm::vec3 b = vertices[tri[(k + 2) % 3]].Position - p;
+      float la = glm::length(a), lb = glm::length(b);
+      if (la <= 0.0f || lb <= 0.0f)
+        continue;
+      float angle = std::acos(glm::clamp(glm::dot(a, b) / (la * lb), -1.0f, 1.0f));
+      tangents[tri[k]] += tangent * angle;
+      bitangents[tri[k]] += bitangent * angle;
+    }
+  }
+
+  for (size_t i = 0; i < vertices.size(); i++)
+  {
+    glm::vec3 n = vertices[i].Normal;
+    glm::vec3 t = tangents[i] - n * glm::dot(n, tangents[i]);
+    float length = glm::length(t);
+    t = length > 1e-6f ? t / length : perpendicular(n);
+    float handedness = glm::dot(glm::cross(n, t), bitangents[i]) < 0.0f ? -1.0f : 1.0f;
+    vertices[i].Tangent = glm::vec4(t, handedness);
+  }
+}
+
+#endif
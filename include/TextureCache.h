@@ -0,0 +1,541 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <stdint.h>
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include <GLDirectState.h>
+#include <MappedFile.h>
+#include <StagingUploader.h>
+#include <TextureCooker.h>
+#include <ThreadPool.h>
+
+// 纹理上传参数, 同一张图片用不同参数上传会得到不同的GL纹理
+struct TextureOptions
+{
+  bool gammaCorrection; // 3/4通道时使用sRGB内部格式
+  bool clampAlpha;      // 4通道的贴图(草、窗户等)用GL_CLAMP_TO_EDGE, 否则边缘会有白边
+  TextureUsage usage;   // 决定压缩格式, 第2位留给翻转状态
+
+  TextureOptions(bool gamma = false, bool clamp = false, TextureUsage use = TEXTURE_AUTO) : gammaCorrection(gamma), clampAlpha(clamp), usage(use) {}
+
+  unsigned int bits() const { return (gammaCorrection ? 1u : 0u) | (clampAlpha ? 2u : 0u) | ((unsigned int)usage << 3); }
+};
+
+// 进程内共享的纹理注册表
+// 以"规范化路径 + 文件内容哈希"为键, 内容相同的图片(比如nanosuit和nanosuit_reflection里同名的png)
+// 只解码上传一次; 每次acquire增加引用计数, 最后一次release时删除GL纹理
+// 开启异步解码后, acquire立刻返回一个绑定了占位图的纹理, stb解码在线程池中进行,
+// 解码好的图片由主线程每帧在processUploads里按字节预算上传到同一个纹理id
+// 第一次解码时会把完整的mip链烘焙到源文件旁边(xxx.png.<烘焙选项>.ctex), 之后直接映射上传, 不再解码和生成mip
+// 烘焙时按用途压缩成BC1/BC3/BC4/BC5, 显存和采样带宽是未压缩时的1/4到1/8
+class TextureCache
+{
+private:
+  struct Entry
+  {
+    unsigned int id;
+    unsigned int refCount;
+  };
+  // 路径上次看到时的大小/修改时间和内容哈希, 文件没变就不用重新读文件算哈希
+  struct PathEntry
+  {
+    FileStamp stamp;
+    uint64_t contentHash;
+  };
+
+  std::unordered_map<uint64_t, Entry> entries;         // 内容键 -> 纹理
+  std::unordered_map<unsigned int, uint64_t> idToKey;  // GL纹理 -> 内容键
+  std::unordered_map<std::string, PathEntry> paths;    // 规范化路径 -> 内容哈希
+  bool flipOnLoad;
+
+  // 异步解码任务, 工作线程准备好mip链后放进ready队列等主线程上传
+  struct DecodeJob
+  {
+    unsigned int id;
+    unsigned int serial;
+    std::string path;
+    TextureOptions options;
+    bool flip;
+    uint64_t hash;
+    std::shared_ptr<MappedFile> file;
+    std::shared_ptr<CookedTexture> image; // 加载失败时为空
+    // 开启暂存上传时, 像素先由工作线程拷进映射的PBO, staged之后主线程只需要发拷贝命令
+    StagingAllocation staging;
+    bool staged;
+  };
+  bool asyncDecode;
+  bool cookTextures;
+  bool compressTextures;
+  unsigned int nextSerial;
+  // 还没上传的纹理 -> 任务序号; 纹理在解码期间被释放时从这里删掉, 结果到了直接丢弃
+  std::unordered_map<unsigned int, unsigned int> pending;
+  std::mutex readyMutex;
+  std::vector<std::shared_ptr<DecodeJob> > ready;
+
+  TextureCache() : flipOnLoad(false), asyncDecode(false), cookTextures(true), compressTextures(true), nextSerial(0) {}
+  TextureCache(const TextureCache &) = delete;
+  TextureCache &operator=(const TextureCache &) = delete;
+
+  bool lookupContent(const std::string &path, uint64_t &hash, MappedFile &file);
+  bool retainKey(uint64_t key, unsigned int &id);
+  void insert(uint64_t key, unsigned int id);
+  unsigned int decodeAsync(const std::string &path, const TextureOptions &options, uint64_t hash, std::shared_ptr<MappedFile> file);
+  static void upload2D(unsigned int id, const CookedTexture &image, const TextureOptions &options, const StagingAllocation *staging = nullptr);
+  uint32_t cookOptions(const TextureOptions &options) const;
+  static uint32_t cookFlags(uint32_t cook, bool flip) { return cook | (flip ? COOK_FLIP : 0u); }
+  void stageAsync(std::shared_ptr<DecodeJob> job);
+
+  static uint64_t combine(uint64_t seed, uint64_t value)
+  {
+    return seed ^ (value + 0x9E3779B97F4A7C15ULL + (seed << 6) + (seed >> 2));
+  }
+public:
+  static TextureCache &instance()
+  {
+    static TextureCache cache;
+    return cache;
+  }
+
+  static std::string normalizePath(const std::string &path);
+
+  // 代替stbi_set_flip_vertically_on_load, 翻转状态也是键的一部分
+  void setFlipOnLoad(bool flip)
+  {
+    flipOnLoad = flip;
+    stbi_set_flip_vertically_on_load(flip);
+  }
+
+  // 之后的acquire在线程池中解码, 需要每帧调用processUploads
+  void setAsyncDecode(bool async) { asyncDecode = async; }
+  // 是否把解码结果和mip链写成.ctex文件, 下次启动直接使用
+  void setCookTextures(bool cook) { cookTextures = cook; }
+  // 是否压缩成BCn格式, 在loadGLExtensions之后才能知道驱动支持哪些格式
+  void setCompressTextures(bool compress) { compressTextures = compress; }
+
+  // 加载2D纹理并增加一次引用, 失败时返回0
+  unsigned int acquire(const std::string &path, const TextureOptions &options = TextureOptions());
+  // 6个面的立方体贴图, 键由6个面的内容哈希组成
+  unsigned int acquireCubemap(const std::vector<std::string> &faces);
+  void retain(unsigned int id);
+  void release(unsigned int id);
+
+  // 在GL线程调用, 上传已经解码好的图片, 超过byteBudget就留到下一帧(至少上传一张), 返回本次上传的数量
+  unsigned int processUploads(size_t byteBudget);
+  // 阻塞直到所有异步纹理都上传完成
+  void finishUploads();
+
+  unsigned int residentCount() const { return (unsigned int)entries.size(); }
+  unsigned int pendingCount() const { return (unsigned int)pending.size(); }
+};
+
+std::string TextureCache::normalizePath(const std::string &path)
+{
+  // 去掉重复的'/'以及"."和"dir/.."片段, 让同一个文件的不同写法得到相同的键
+  std::vector<std::string> parts;
+  bool absolute = !path.empty() && path[0] == '/';
+  size_t start = 0;
+  while (start <= path.size())
+  {
+    size_t end = path.find('/', start);
+    if (end == std::string::npos)
+      end = path.size();
+    std::string part = path.substr(start, end - start);
+    if (part == "..")
+    {
+      if (!parts.empty() && parts.back() != "..")
+        parts.pop_back();
+      else if (!absolute)
+        parts.push_back(part);
+    }
+    else if (!part.empty() && part != ".")
+      parts.push_back(part);
+    start = end + 1;
+  }
+  std::string result = absolute ? "/" : "";
+  for (unsigned int i = 0; i < parts.size(); i++)
+  {
+    if (i > 0)
+      result += '/';
+    result += parts[i];
+  }
+  return result;
+}
+
+bool TextureCache::lookupContent(const std::string &path, uint64_t &hash, MappedFile &file)
+{
+  FileStamp stamp;
+  if (!statFile(path, stamp))
+    return false;
+  std::string key = normalizePath(path);
+  std::unordered_map<std::string, PathEntry>::iterator it = paths.find(key);
+  if (it != paths.end() && it->second.stamp.size == stamp.size && it->second.stamp.mtime == stamp.mtime)
+  {
+    hash = it->second.contentHash;
+    return true;
+  }
+  if (!file.open(path))
+    return false;
+  hash = hashBytes(file.data(), file.size());
+  PathEntry entry;
+  entry.stamp = stamp;
+  entry.contentHash = hash;
+  paths[key] = entry;
+  return true;
+}
+
+bool TextureCache::retainKey(uint64_t key, unsigned int &id)
+{
+  std::unordered_map<uint64_t, Entry>::iterator it = entries.find(key);
+  if (it == entries.end())
+    return false;
+  it->second.refCount++;
+  id = it->second.id;
+  return true;
+}
+
+void TextureCache::insert(uint64_t key, unsigned int id)
+{
+  Entry entry;
+  entry.id = id;
+  entry.refCount = 1;
+  entries[key] = entry;
+  idToKey[id] = key;
+}
+
+uint32_t TextureCache::cookOptions(const TextureOptions &options) const
+{
+  uint32_t bits = (options.gammaCorrection ? COOK_SRGB : 0) | ((uint32_t)options.usage << COOK_USAGE_SHIFT);
+  if (compressTextures)
+  {
+    // RGTC是3.0的核心功能; S3TC是扩展, sRGB贴图还要求有对应的sRGB格式
+    const GLCapabilities &caps = glCapabilities();
+    bits |= COOK_BC_RGTC;
+    if (caps.textureS3TC && (!options.gammaCorrection || caps.textureSRGBS3TC))
+      bits |= COOK_BC_COLOR;
+  }
+  return bits;
+}
+
+unsigned int TextureCache::acquire(const std::string &path, const TextureOptions &requested)
+{
+  TextureOptions options = requested;
+  if (options.usage == TEXTURE_AUTO)
+    options.usage = textureUsageFromPath(path);
+
+  // 读文件和算哈希留在当前线程, 这样内容去重可以立刻得到结果; 真正耗时的是解码
+  std::shared_ptr<MappedFile> file(new MappedFile());
+  uint64_t hash;
+  if (!lookupContent(path, hash, *file))
+  {
+    std::cout << "Texture failed to load at path: " << path << std::endl;
+    return 0;
+  }
+  uint64_t key = combine(hash, options.bits() | (flipOnLoad ? 4u : 0u));
+  unsigned int textureID;
+  if (retainKey(key, textureID))
+    return textureID;
+
+  if (asyncDecode)
+  {
+    textureID = decodeAsync(path, options, hash, file);
+    insert(key, textureID);
+    return textureID;
+  }
+
+  // 有烘焙好的文件时直接映射上传; 没有时才打开源文件解码
+  CookedTexture image;
+  if (!image.load(path, *file, hash, cookFlags(cookOptions(options), flipOnLoad), cookTextures))
+  {
+    std::cout << "Texture failed to load at path: " << path << std::endl;
+    return 0;
+  }
+  textureID = createTextureObject(GL_TEXTURE_2D);
+  upload2D(textureID, image, options);
+  insert(key, textureID);
+  return textureID;
+}
+
+unsigned int TextureCache::decodeAsync(const std::string &path, const TextureOptions &options, uint64_t hash, std::shared_ptr<MappedFile> file)
+{
+  unsigned int textureID = createTextureObject(GL_TEXTURE_2D);
+  // 解码完成之前先用1x1的灰色占位, 纹理id马上就能交给Mesh使用
+  // 占位图必须是可变存储(直接访问也一样要绑定), 解码完成后upload2D才能在同一个纹理上重新分配
+  const unsigned char placeholder[4] = { 128, 128, 128, 255 };
+  GLState::instance().bindTexture(GL_TEXTURE_2D, textureID);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+  textureParameter(textureID, GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  textureParameter(textureID, GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+  std::shared_ptr<DecodeJob> job(new DecodeJob());
+  job->id = textureID;
+  job->serial = ++nextSerial;
+  job->path = path;
+  job->options = options;
+  job->flip = flipOnLoad;
+  job->hash = hash;
+  job->file = file;
+  job->staged = false;
+  pending[textureID] = job->serial;
+
+  TextureCache *cache = this;
+  uint32_t flags = cookFlags(cookOptions(options), flipOnLoad);
+  bool cook = cookTextures;
+  ThreadPool::shared().submit([cache, job, flags, cook]()
+  {
+    // 翻转状态是全局的, 工作线程里用线程局部的设置
+    stbi_set_flip_vertically_on_load_thread(job->flip);
+    std::shared_ptr<CookedTexture> image(new CookedTexture());
+    if (image->load(job->path, *job->file, job->hash, flags, cook))
+      job->image = image;
+    job->file.reset();
+    std::lock_guard<std::mutex> lock(cache->readyMutex);
+    cache->ready.push_back(job);
+  });
+  return textureID;
+}
+
+void TextureCache::stageAsync(std::shared_ptr<DecodeJob> job)
+{
+  // 拷贝也交给工作线程, 拷完重新放回ready队列, 下次processUploads再提交
+  TextureCache *cache = this;
+  ThreadPool::shared().submit([cache, job]()
+  {
+    memcpy(job->staging.data, job->image->data(), job->staging.size);
+    job->staged = true;
+    std::lock_guard<std::mutex> lock(cache->readyMutex);
+    cache->ready.push_back(job);
+  });
+}
+
+unsigned int TextureCache::processUploads(size_t byteBudget)
+{
+  std::vector<std::shared_ptr<DecodeJob> > batch;
+  {
+    std::lock_guard<std::mutex> lock(readyMutex);
+    batch.swap(ready);
+  }
+  StagingUploader &uploader = StagingUploader::instance();
+  std::vector<std::shared_ptr<DecodeJob> > leftover;
+  size_t used = 0;
+  unsigned int uploaded = 0;
+  for (unsigned int i = 0; i < batch.size(); i++)
+  {
+    std::shared_ptr<DecodeJob> job = batch[i];
+    std::unordered_map<unsigned int, unsigned int>::iterator it = pending.find(job->id);
+    // 序号对不上说明纹理已经被释放(id可能已经被别的纹理复用), 结果直接丢弃
+    if (it == pending.end() || it->second != job->serial)
+    {
+      if (job->staged)
+        uploader.discard(job->staging);
+      continue;
+    }
+    if (!job->image)
+    {
+      pending.erase(it);
+      std::cout << "Texture failed to load at path: " << job->path << std::endl;
+      continue;
+    }
+    // 超出预算的留到下一帧
+    if (uploaded > 0 && used >= byteBudget)
+    {
+      leftover.push_back(job);
+      continue;
+    }
+    size_t bytes = job->image->dataSize();
+    if (!job->staged && uploader.isEnabled())
+    {
+      // 暂存区满了不等待, 下一帧再试
+      if (uploader.allocate(bytes, job->staging, false))
+        stageAsync(job);
+      else
+        leftover.push_back(job);
+      continue;
+    }
+    pending.erase(it);
+    upload2D(job->id, *job->image, job->options, job->staged ? &job->staging : nullptr);
+    job->image.reset();
+    used += bytes;
+    uploaded++;
+  }
+  // 放回队列前面保持先后顺序
+  if (!leftover.empty())
+  {
+    std::lock_guard<std::mutex> lock(readyMutex);
+    ready.insert(ready.begin(), leftover.begin(), leftover.end());
+  }
+  return uploaded;
+}
+
+void TextureCache::finishUploads()
+{
+  while (!pending.empty())
+  {
+    if (processUploads((size_t)-1) == 0)
+    {
+      // 暂存块可能都还在等fence, 回收一下再继续
+      StagingUploader::instance().endFrame();
+      std::this_thread::yield();
+    }
+  }
+}
+
+void TextureCache::upload2D(unsigned int textureID, const CookedTexture &image, const TextureOptions &options, const StagingAllocation *staging)
+{
+  GLenum wrap = (options.clampAlpha && image.format == GL_RGBA) ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+  unsigned int levelCount = (unsigned int)image.levels.size();
+
+  // 每一级mip都是紧密排列的, 奇数宽度的RGB行不是4字节对齐; 压缩格式不受影响
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  if (staging)
+  {
+    std::vector<StagingTextureLevel> levels(levelCount);
+    for (unsigned int i = 0; i < levelCount; i++)
+    {
+      levels[i].width = image.levels[i].width;
+      levels[i].height = image.levels[i].height;
+      levels[i].offset = (size_t)image.levels[i].offset;
+      levels[i].size = (size_t)image.levels[i].size;
+    }
+    StagingUploader::instance().submitTexture2D(*staging, textureID, image.internalFormat, image.format, image.type, &levels[0], levelCount);
+  }
+  else if (glCapabilities().directStateAccess)
+  {
+    textureStorage(textureID, GL_TEXTURE_2D, levelCount, image.internalFormat, image.levels[0].width, image.levels[0].height, image.format, image.type);
+    for (unsigned int i = 0; i < levelCount; i++)
+    {
+      const CookedTextureLevel &level = image.levels[i];
+      if (image.compressed())
+        glCompressedTextureSubImage2D(textureID, i, 0, 0, level.width, level.height, image.internalFormat, (GLsizei)level.size, image.levelData(i));
+      else
+        glTextureSubImage2D(textureID, i, 0, 0, level.width, level.height, image.format, image.type, image.levelData(i));
+    }
+  }
+  else
+  {
+    GLState::instance().bindTexture(GL_TEXTURE_2D, textureID);
+    for (unsigned int i = 0; i < levelCount; i++)
+    {
+      const CookedTextureLevel &level = image.levels[i];
+      if (image.compressed())
+        glCompressedTexImage2D(GL_TEXTURE_2D, i, image.internalFormat, level.width, level.height, 0, (GLsizei)level.size, image.levelData(i));
+      else
+        glTexImage2D(GL_TEXTURE_2D, i, image.internalFormat, level.width, level.height, 0, image.format, image.type, image.levelData(i));
+    }
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+  // mip链是烘焙好的, 不需要glGenerateMipmap
+  textureParameter(textureID, GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+  textureParameter(textureID, GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+  if (image.flags & COOKED_BROADCAST_RED)
+  {
+    // 单通道的遮罩当成灰度图采样, 着色器里读.rgb和原来的RGB贴图结果一样
+    GLint swizzle[] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+    textureParameter(textureID, GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+  }
+  textureParameter(textureID, GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+  textureParameter(textureID, GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+  textureParameter(textureID, GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  textureParameter(textureID, GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+unsigned int TextureCache::acquireCubemap(const std::vector<std::string> &faces)
+{
+  // 立方体贴图的键: 每个面的内容哈希按顺序组合, 再加上翻转状态
+  std::vector<MappedFile> files(faces.size());
+  uint64_t key = combine(0xC0BE3A9ULL, flipOnLoad ? 1u : 0u);
+  for (unsigned int i = 0; i < faces.size(); i++)
+  {
+    uint64_t hash = 0;
+    if (!lookupContent(faces[i], hash, files[i]))
+      std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
+    key = combine(key, hash);
+  }
+
+  unsigned int textureID;
+  if (!retainKey(key, textureID))
+  {
+    textureID = createTextureObject(GL_TEXTURE_CUBE_MAP);
+    bool direct = glCapabilities().directStateAccess;
+    bool allocated = false;
+    if (!direct)
+      GLState::instance().bindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+
+    int width, height, nrChannels;
+    for (unsigned int i = 0; i < faces.size(); i++)
+    {
+      unsigned char *data = nullptr;
+      if (files[i].isOpen() || files[i].open(faces[i]))
+        data = stbi_load_from_memory(files[i].data(), (int)files[i].size(), &width, &height, &nrChannels, 0);
+      if (data)
+      {
+        GLenum format = GL_RED;
+        if (nrChannels == 3)
+          format = GL_RGB;
+        else if (nrChannels == 4)
+          format = GL_RGBA;  // 4通道, 包含alpha通道(透明度)
+
+        if (direct)
+        {
+          // 不可变存储按第一个面的大小和格式一次分配6个面和完整的mip链, 各个面当成数组的一层写入
+          if (!allocated)
+            textureStorage(textureID, GL_TEXTURE_CUBE_MAP, mipLevelCount(width, height), format, width, height, format, GL_UNSIGNED_BYTE);
+          allocated = true;
+          glTextureSubImage3D(textureID, 0, 0, 0, i, width, height, 1, format, GL_UNSIGNED_BYTE, data);
+        }
+        else
+          glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+        stbi_image_free(data);
+      }
+      else
+      {
+        std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
+      }
+    }
+    if (allocated || !direct)
+      generateMipmap(textureID, GL_TEXTURE_CUBE_MAP);
+    textureParameter(textureID, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    textureParameter(textureID, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    textureParameter(textureID, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    textureParameter(textureID, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    textureParameter(textureID, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    insert(key, textureID);
+  }
+  return textureID;
+}
+
+void TextureCache::retain(unsigned int id)
+{
+  std::unordered_map<unsigned int, uint64_t>::iterator it = idToKey.find(id);
+  if (it != idToKey.end())
+    entries[it->second].refCount++;
+}
+
+void TextureCache::release(unsigned int id)
+{
+  std::unordered_map<unsigned int, uint64_t>::iterator it = idToKey.find(id);
+  if (it == idToKey.end())
+    return;
+  std::unordered_map<uint64_t, Entry>::iterator entry = entries.find(it->second);
+  if (--entry->second.refCount == 0)
+  {
+    // 路径表里的哈希留着, 下次加载同一个文件时不用重新算
+    GLState::instance().forgetTexture(id);
+    glDeleteTextures(1, &id);
+    entries.erase(entry);
+    idToKey.erase(it);
+    pending.erase(id);
+  }
+}
+
+#endif
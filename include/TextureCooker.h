@@ -0,0 +1,485 @@
+#ifndef TEXTURE_COOKER_H
+#define TEXTURE_COOKER_H
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <cstdlib>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include <BlockCompression.h>
+#include <Diagnostics.h>
+#include <GLExtensions.h>
+#include <MappedFile.h>
+
+// 烘焙后的纹理文件(xxx.png.<烘焙选项>.ctex), 类似KTX: 文件头 | 每一级mip的描述 | 像素数据
+// 像素已经是最终上传的格式(未压缩或者BCn块), 每一级都是紧密排列的,
+// 运行时映射文件后逐级glTexImage2D/glCompressedTexImage2D即可, 不需要解码, 也不需要glGenerateMipmap
+// 修改了文件布局、mip生成方式或者编码器时要增加版本号
+const uint32_t COOKED_TEXTURE_VERSION = 3;
+
+// 贴图的用途, 决定压缩格式:
+// 颜色 -> BC1/BC3; 遮罩(高光、AO、粗糙度、金属度) -> BC4, 采样时红色通道广播到rgb;
+// 法线 -> BC5只存XY, 着色器里用sqrt(1 - x*x - y*y)重建Z
+enum TextureUsage
+{
+  TEXTURE_COLOR = 0,
+  TEXTURE_MASK = 1,
+  TEXTURE_NORMAL = 2,
+  TEXTURE_AUTO = 3 // 根据文件名判断, 见textureUsageFromPath
+};
+
+// 烘焙选项, 任何一位不同都会重新烘焙
+const uint32_t COOK_SRGB = 1;        // 颜色通道是sRGB, 和TextureOptions::bits()的第0位一致
+const uint32_t COOK_FLIP = 4;        // 解码时上下翻转
+const uint32_t COOK_BC_COLOR = 8;    // 颜色贴图可以压缩成BC1/BC3(需要S3TC扩展)
+const uint32_t COOK_BC_RGTC = 16;    // 遮罩和法线贴图可以压缩成BC4/BC5
+const uint32_t COOK_USAGE_SHIFT = 5; // 第5、6位是TextureUsage
+
+// 文件头里的标志
+const uint32_t COOKED_BROADCAST_RED = 1; // 上传时设置swizzle为(R, R, R, 1)
+
+struct CookedTextureHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t options;    // 烘焙时的参数(sRGB、翻转), 不一致时重新烘焙
+  uint64_t sourceHash; // 源图片的内容哈希
+  uint32_t internalFormat;
+  uint32_t format;
+  uint32_t type;
+  uint32_t width;
+  uint32_t height;
+  uint32_t channels;
+  uint32_t levelCount;
+  uint32_t flags;
+  uint64_t dataOffset;
+  uint64_t dataSize;
+  float psnr;          // 压缩后第0级的PSNR, 未压缩时为0
+  uint32_t reserved;
+};
+
+struct CookedTextureLevel
+{
+  uint32_t width;
+  uint32_t height;
+  uint64_t offset; // 相对像素数据开头
+  uint64_t size;
+};
+
+// 按文件名猜贴图用途, 用于没有材质信息的贴图(main.cpp里直接加载的那些)
+inline TextureUsage textureUsageFromPath(const std::string &path)
+{
+  std::string name = path.substr(path.find_last_of('/') + 1);
+  for (unsigned int i = 0; i < name.size(); i++)
+    name[i] = (char)tolower((unsigned char)name[i]);
+  static const char *normals[] = { "normal", "_ddn", "_nrm", "_norm" };
+  static const char *masks[] = { "specular", "_spec", "_ao", "roughness", "metallic", "_disp", "_height" };
+  for (unsigned int i = 0; i < sizeof(normals) / sizeof(normals[0]); i++)
+    if (name.find(normals[i]) != std::string::npos)
+      return TEXTURE_NORMAL;
+  for (unsigned int i = 0; i < sizeof(masks) / sizeof(masks[0]); i++)
+    if (name.find(masks[i]) != std::string::npos)
+      return TEXTURE_MASK;
+  return TEXTURE_COLOR;
+}
+
+class CookedTexture
+{
+private:
+  MappedFile file;
+  std::vector<unsigned char> storage;
+  const unsigned char *base;
+
+  CookedTexture(const CookedTexture &) = delete;
+  CookedTexture &operator=(const CookedTexture &) = delete;
+
+  bool openCooked(const std::string &path, uint64_t sourceHash, uint32_t options);
+  void cook(const unsigned char *pixels, int w, int h, int n, uint32_t options);
+  void buildMips(const unsigned char *pixels, bool srgb, bool normal);
+  void compressLevels(BlockFormat blockFormat);
+  bool write(const std::string &path, uint64_t sourceHash, uint32_t options) const;
+public:
+  uint32_t internalFormat;
+  uint32_t format;
+  uint32_t type;
+  uint32_t width;
+  uint32_t height;
+  uint32_t channels;
+  uint32_t flags;
+  float psnr;
+  std::vector<CookedTextureLevel> levels;
+
+  CookedTexture() : base(nullptr), internalFormat(0), format(0), type(0), width(0), height(0), channels(0), flags(0), psnr(0.0f) {}
+
+  // 烘焙选项(包括驱动支持的压缩格式)写进文件名, 不同选项的结果可以同时存在, 换驱动或者同一张图用作不同用途时不会互相覆盖
+  static std::string cookedPath(const std::string &sourcePath, uint32_t options)
+  {
+    char suffix[16];
+    snprintf(suffix, sizeof(suffix), ".%02x.ctex", options);
+    return sourcePath + suffix;
+  }
+
+  // 优先映射已经烘焙好的文件; 没有或者过期时解码源文件、生成mip链, writeCooked为true时顺便写回磁盘
+  // source是源文件的映射, 只有需要解码时才会打开; 解码时的翻转状态由调用方所在线程决定
+  bool load(const std::string &sourcePath, MappedFile &source, uint64_t sourceHash, uint32_t options, bool writeCooked);
+
+  // 压缩格式的type为0, format记录的是源图片的通道布局
+  bool compressed() const { return type == 0; }
+  const unsigned char *data() const { return base; }
+  const unsigned char *levelData(unsigned int level) const { return base + levels[level].offset; }
+  size_t dataSize() const
+  {
+    return levels.empty() ? 0 : (size_t)(levels.back().offset + levels.back().size);
+  }
+};
+
+// sRGB和线性空间之间的转换表, mip生成时在线性空间里做平均, 否则暗部会被过度加亮/压暗
+struct SrgbTables
+{
+  float toLinear[256];
+  unsigned char fromLinear[4096];
+
+  SrgbTables()
+  {
+    for (int i = 0; i < 256; i++)
+    {
+      float c = i / 255.0f;
+      toLinear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+    }
+    for (int i = 0; i < 4096; i++)
+    {
+      float l = i / 4095.0f;
+      float c = l <= 0.0031308f ? l * 12.92f : 1.055f * powf(l, 1.0f / 2.4f) - 0.055f;
+      fromLinear[i] = (unsigned char)(c * 255.0f + 0.5f);
+    }
+  }
+
+  static const SrgbTables &get()
+  {
+    static SrgbTables tables;
+    return tables;
+  }
+};
+
+inline const char *compressedFormatName(uint32_t internalFormat)
+{
+  switch (internalFormat)
+  {
+  case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+  case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+    return "BC1";
+  case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+  case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+    return "BC3";
+  case GL_COMPRESSED_RED_RGTC1:
+    return "BC4";
+  case GL_COMPRESSED_RG_RGTC2:
+    return "BC5";
+  }
+  return "uncompressed";
+}
+
+bool CookedTexture::load(const std::string &sourcePath, MappedFile &source, uint64_t sourceHash, uint32_t options, bool writeCooked)
+{
+  std::string path = cookedPath(sourcePath, options);
+  if (openCooked(path, sourceHash, options))
+    return true;
+
+  if (!source.isOpen() && !source.open(sourcePath))
+    return false;
+  int w, h, n;
+  unsigned char *pixels = stbi_load_from_memory(source.data(), (int)source.size(), &w, &h, &n, 0);
+  if (!pixels)
+    return false;
+  size_t rawSize = (size_t)w * h * n;
+  cook(pixels, w, h, n, options);
+  stbi_image_free(pixels);
+  if (compressed() && Diagnostics::verboseLoading)
+  {
+    // 在解码线程里调用, 整行一次输出, 不和其它线程的输出交错
+    std::ostringstream line;
+    line << std::fixed << std::setprecision(1) << "TEXTURE::COOK::" << sourcePath << " " << width << "x" << height << " "
+         << compressedFormatName(internalFormat) << ", " << rawSize * 4 / 3 / 1024 << " KB -> " << dataSize() / 1024 << " KB, PSNR " << psnr << " dB\n";
+    std::cout << line.str() << std::flush;
+  }
+
+  if (writeCooked && !write(path, sourceHash, options))
+    std::cout << "WARNING::TEXTURE::failed to write cooked texture " + path + "\n" << std::flush;
+  return true;
+}
+
+bool CookedTexture::openCooked(const std::string &path, uint64_t sourceHash, uint32_t options)
+{
+  if (!file.open(path))
+    return false;
+  if (file.size() < sizeof(CookedTextureHeader))
+  {
+    file.close();
+    return false;
+  }
+  const CookedTextureHeader *header = (const CookedTextureHeader *)file.data();
+  uint64_t tableEnd = sizeof(CookedTextureHeader) + (uint64_t)header->levelCount * sizeof(CookedTextureLevel);
+  if (memcmp(header->magic, "CTEXTURE", 8) != 0 || header->version != COOKED_TEXTURE_VERSION ||
+      header->options != options || header->sourceHash != sourceHash || header->levelCount == 0 ||
+      tableEnd > header->dataOffset || header->dataOffset + header->dataSize != file.size())
+  {
+    file.close();
+    return false;
+  }
+  const CookedTextureLevel *table = (const CookedTextureLevel *)(file.data() + sizeof(CookedTextureHeader));
+  levels.assign(table, table + header->levelCount);
+  if (levels.back().offset + levels.back().size > header->dataSize)
+  {
+    file.close();
+    return false;
+  }
+  internalFormat = header->internalFormat;
+  format = header->format;
+  type = header->type;
+  width = header->width;
+  height = header->height;
+  channels = header->channels;
+  flags = header->flags;
+  psnr = header->psnr;
+  base = file.data() + header->dataOffset;
+  return true;
+}
+
+void CookedTexture::cook(const unsigned char *pixels, int w, int h, int n, uint32_t options)
+{
+  TextureUsage usage = (TextureUsage)((options >> COOK_USAGE_SHIFT) & 3);
+  // 只有颜色贴图才按sRGB处理
+  bool srgb = (options & COOK_SRGB) != 0 && usage == TEXTURE_COLOR;
+  flags = 0;
+  psnr = 0.0f;
+
+  // 遮罩只保留一个通道; 要求sRGB时先转到线性空间, 因为BC4没有sRGB格式; 单通道的遮罩也一样转换, 结果不取决于PNG的存储方式
+  std::vector<unsigned char> mask;
+  bool linearize = (options & COOK_SRGB) != 0;
+  if (usage == TEXTURE_MASK && (n != 1 || linearize))
+  {
+    const SrgbTables &tables = SrgbTables::get();
+    mask.resize((size_t)w * h);
+    for (size_t i = 0; i < mask.size(); i++)
+    {
+      const unsigned char *p = pixels + i * n;
+      if (n < 3)
+        mask[i] = linearize ? (unsigned char)(tables.toLinear[p[0]] * 255.0f + 0.5f) : p[0];
+      else if (linearize)
+        mask[i] = (unsigned char)((0.2126f * tables.toLinear[p[0]] + 0.7152f * tables.toLinear[p[1]] + 0.0722f * tables.toLinear[p[2]]) * 255.0f + 0.5f);
+      else
+        mask[i] = (unsigned char)(0.2126f * p[0] + 0.7152f * p[1] + 0.0722f * p[2] + 0.5f);
+    }
+    pixels = &mask[0];
+    n = 1;
+  }
+  if (usage == TEXTURE_MASK)
+    flags |= COOKED_BROADCAST_RED;
+
+  width = w;
+  height = h;
+  channels = n;
+  type = GL_UNSIGNED_BYTE;
+  if (n == 1)
+    internalFormat = format = GL_RED;
+  else if (n == 2)
+    internalFormat = format = GL_RG;
+  else if (n == 3)
+  {
+    internalFormat = srgb ? GL_SRGB : GL_RGB;
+    format = GL_RGB;
+  }
+  else
+  {
+    internalFormat = srgb ? GL_SRGB_ALPHA : GL_RGBA;
+    format = GL_RGBA;
+  }
+  buildMips(pixels, srgb, usage == TEXTURE_NORMAL);
+
+  if (n == 1 && (options & COOK_BC_RGTC))
+  {
+    internalFormat = GL_COMPRESSED_RED_RGTC1;
+    compressLevels(BLOCK_BC4);
+  }
+  else if (usage == TEXTURE_NORMAL && n >= 3 && (options & COOK_BC_RGTC))
+  {
+    internalFormat = GL_COMPRESSED_RG_RGTC2;
+    compressLevels(BLOCK_BC5);
+  }
+  else if (usage == TEXTURE_COLOR && n >= 3 && (options & COOK_BC_COLOR))
+  {
+    // alpha全是255的RGBA贴图也用BC1, 省一半空间
+    bool opaque = true;
+    for (size_t i = 3; n == 4 && opaque && i < (size_t)levels[0].size; i += 4)
+      opaque = storage[i] == 255;
+    if (opaque)
+      internalFormat = srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    else
+      internalFormat = srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    compressLevels(opaque ? BLOCK_BC1 : BLOCK_BC3);
+  }
+  base = &storage[0];
+}
+
+void CookedTexture::buildMips(const unsigned char *pixels, bool srgb, bool normal)
+{
+  int n = (int)channels;
+  // 灰度/双通道贴图不做sRGB处理; alpha通道永远是线性的
+  bool linearize = srgb && n >= 3;
+  int colorChannels = n == 4 ? 3 : n;
+
+  // 先算出每一级的大小和偏移, 一次分配好
+  levels.clear();
+  uint64_t offset = 0;
+  for (uint32_t lw = width, lh = height; ; lw = lw > 1 ? lw / 2 : 1, lh = lh > 1 ? lh / 2 : 1)
+  {
+    CookedTextureLevel level;
+    level.width = lw;
+    level.height = lh;
+    level.offset = offset;
+    level.size = (uint64_t)lw * lh * n;
+    levels.push_back(level);
+    offset += level.size;
+    if (lw == 1 && lh == 1)
+      break;
+  }
+  storage.resize((size_t)offset);
+  memcpy(&storage[0], pixels, (size_t)levels[0].size);
+
+  const SrgbTables &tables = SrgbTables::get();
+  for (unsigned int l = 1; l < levels.size(); l++)
+  {
+    const CookedTextureLevel &src = levels[l - 1];
+    const CookedTextureLevel &dst = levels[l];
+    const unsigned char *in = &storage[(size_t)src.offset];
+    unsigned char *out = &storage[(size_t)dst.offset];
+    for (uint32_t y = 0; y < dst.height; y++)
+    {
+      // 奇数尺寸时最后一行/列重复使用边缘像素
+      uint32_t y0 = y * 2 < src.height ? y * 2 : src.height - 1;
+      uint32_t y1 = y * 2 + 1 < src.height ? y * 2 + 1 : y0;
+      for (uint32_t x = 0; x < dst.width; x++)
+      {
+        uint32_t x0 = x * 2 < src.width ? x * 2 : src.width - 1;
+        uint32_t x1 = x * 2 + 1 < src.width ? x * 2 + 1 : x0;
+        const unsigned char *p00 = in + (y0 * src.width + x0) * n;
+        const unsigned char *p01 = in + (y0 * src.width + x1) * n;
+        const unsigned char *p10 = in + (y1 * src.width + x0) * n;
+        const unsigned char *p11 = in + (y1 * src.width + x1) * n;
+        unsigned char *o = out + (y * dst.width + x) * n;
+        for (int c = 0; c < n; c++)
+        {
+          if (linearize && c < colorChannels)
+          {
+            float l = (tables.toLinear[p00[c]] + tables.toLinear[p01[c]] + tables.toLinear[p10[c]] + tables.toLinear[p11[c]]) * 0.25f;
+            o[c] = tables.fromLinear[(int)(l * 4095.0f + 0.5f)];
+          }
+          else
+            o[c] = (unsigned char)((p00[c] + p01[c] + p10[c] + p11[c] + 2) / 4);
+        }
+        // 平均后的法线变短了, 重新归一化
+        if (normal && n >= 3)
+        {
+          float v[3], length = 0.0f;
+          for (int c = 0; c < 3; c++)
+          {
+            v[c] = o[c] / 127.5f - 1.0f;
+            length += v[c] * v[c];
+          }
+          length = sqrtf(length);
+          if (length > 1e-4f)
+            for (int c = 0; c < 3; c++)
+              o[c] = (unsigned char)((v[c] / length * 0.5f + 0.5f) * 255.0f + 0.5f);
+        }
+      }
+    }
+  }
+}
+
+void CookedTexture::compressLevels(BlockFormat blockFormat)
+{
+  std::vector<CookedTextureLevel> compressedLevels(levels.size());
+  uint64_t offset = 0;
+  for (unsigned int l = 0; l < levels.size(); l++)
+  {
+    compressedLevels[l].width = levels[l].width;
+    compressedLevels[l].height = levels[l].height;
+    compressedLevels[l].offset = offset;
+    compressedLevels[l].size = compressedSize(blockFormat, levels[l].width, levels[l].height);
+    offset += compressedLevels[l].size;
+  }
+  std::vector<unsigned char> blocks((size_t)offset);
+  for (unsigned int l = 0; l < levels.size(); l++)
+  {
+    double quality = compressImage(blockFormat, &storage[(size_t)levels[l].offset], levels[l].width, levels[l].height, channels, &blocks[(size_t)compressedLevels[l].offset]);
+    if (l == 0)
+      psnr = (float)quality;
+  }
+  storage.swap(blocks);
+  levels.swap(compressedLevels);
+  type = 0;
+}
+
+bool CookedTexture::write(const std::string &path, uint64_t sourceHash, uint32_t options) const
+{
+  CookedTextureHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "CTEXTURE", 8);
+  header.version = COOKED_TEXTURE_VERSION;
+  header.options = options;
+  header.sourceHash = sourceHash;
+  header.internalFormat = internalFormat;
+  header.format = format;
+  header.type = type;
+  header.width = width;
+  header.height = height;
+  header.channels = channels;
+  header.levelCount = (uint32_t)levels.size();
+  header.flags = flags;
+  header.psnr = psnr;
+  // 像素数据按16字节对齐
+  header.dataOffset = (sizeof(CookedTextureHeader) + levels.size() * sizeof(CookedTextureLevel) + 15) & ~(uint64_t)15;
+  header.dataSize = dataSize();
+
+  // 多个解码线程(或者多个进程)可能同时烘焙同一张图, 每个写入者用自己的临时文件, 最后的rename是原子的
+  std::string tmpPath = path + ".XXXXXX";
+  int fd = mkstemp(&tmpPath[0]);
+  if (fd < 0)
+    return false;
+  // mkstemp创建的文件只有所有者可读写, 改成和普通文件一样
+  fchmod(fd, 0644);
+  FILE *out = fdopen(fd, "wb");
+  if (!out)
+  {
+    close(fd);
+    remove(tmpPath.c_str());
+    return false;
+  }
+  static const unsigned char padding[16] = { 0 };
+  size_t headerBytes = sizeof(CookedTextureHeader) + levels.size() * sizeof(CookedTextureLevel);
+  bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+  ok = ok && fwrite(&levels[0], sizeof(CookedTextureLevel), levels.size(), out) == levels.size();
+  ok = ok && fwrite(padding, 1, (size_t)header.dataOffset - headerBytes, out) == (size_t)header.dataOffset - headerBytes;
+  ok = ok && fwrite(base, 1, dataSize(), out) == dataSize();
+  ok = fclose(out) == 0 && ok;
+  if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0)
+  {
+    remove(tmpPath.c_str());
+    return false;
+  }
+  return true;
+}
+
+#endif
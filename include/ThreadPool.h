@@ -0,0 +1,141 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <atomic>
+
+// 简单的线程池, 只用来跑不涉及OpenGL调用的CPU任务(网格转换、图片解码等)
+// OpenGL上下文只属于主线程, 提交到这里的任务里不能调用任何gl函数
+class ThreadPool
+{
+private:
+  std::vector<std::thread> workers;
+  std::queue<std::function<void()> > tasks;
+  std::mutex queueMutex;
+  std::condition_variable condition;
+  bool stopping;
+
+  void workerLoop();
+public:
+  explicit ThreadPool(unsigned int threadCount = 0);
+  ~ThreadPool();
+
+  // 提交一个任务, 通过返回的future拿结果
+  template<class F>
+  std::future<typename std::result_of<F()>::type> submit(F f);
+
+  // 把[0, count)的下标逐个分给线程池执行body, 调用线程也一起干活, 全部完成后返回
+  // 调用线程自己就能把活干完, 所以在工作线程里调用也不会因为等待其他任务而死锁
+  void parallelFor(unsigned int count, const std::function<void(unsigned int)> &body);
+
+  unsigned int size() const { return (unsigned int)workers.size(); }
+
+  // 进程内共享的线程池, 第一次使用时创建
+  static ThreadPool &shared()
+  {
+    static ThreadPool pool;
+    return pool;
+  }
+};
+
+ThreadPool::ThreadPool(unsigned int threadCount) : stopping(false)
+{
+  if (threadCount == 0)
+  {
+    // 留一个核给主线程
+    unsigned int cores = std::thread::hardware_concurrency();
+    threadCount = cores > 1 ? cores - 1 : 1;
+  }
+  for (unsigned int i = 0; i < threadCount; i++)
+    workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::unique_lock<std::mutex> lock(queueMutex);
+    stopping = true;
+  }
+  condition.notify_all();
+  for (unsigned int i = 0; i < workers.size(); i++)
+    workers[i].join();
+}
+
+void ThreadPool::workerLoop()
+{
+  for (;;)
+  {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(queueMutex);
+      while (!stopping && tasks.empty())
+        condition.wait(lock);
+      if (stopping && tasks.empty())
+        return;
+      task = tasks.front();
+      tasks.pop();
+    }
+    task();
+  }
+}
+
+void ThreadPool::parallelFor(unsigned int count, const std::function<void(unsigned int)> &body)
+{
+  struct Range
+  {
+    std::atomic<unsigned int> next;
+    std::atomic<unsigned int> done;
+    unsigned int count;
+    std::function<void(unsigned int)> body;
+  };
+  std::shared_ptr<Range> range(new Range());
+  range->next = 0;
+  range->done = 0;
+  range->count = count;
+  range->body = body;
+  // 每次领一个下标, 领完的任务直接返回; 晚启动的任务可能在函数返回后才运行, 所以状态放在shared_ptr里
+  std::function<void()> run = [range]()
+  {
+    unsigned int i;
+    while ((i = range->next++) < range->count)
+    {
+      range->body(i);
+      range->done++;
+    }
+  };
+  unsigned int helpers = count > 1 ? (count - 1 < size() ? count - 1 : size()) : 0;
+  {
+    std::unique_lock<std::mutex> lock(queueMutex);
+    for (unsigned int i = 0; i < helpers; i++)
+      tasks.push(run);
+  }
+  condition.notify_all();
+  run();
+  // 剩下的是已经被其他线程领走、正在执行的下标
+  while (range->done < count)
+    std::this_thread::yield();
+}
+
+template<class F>
+std::future<typename std::result_of<F()>::type> ThreadPool::submit(F f)
+{
+  typedef typename std::result_of<F()>::type Result;
+  // packaged_task不能拷贝, 用shared_ptr包一层才能放进std::function
+  std::shared_ptr<std::packaged_task<Result()> > task(new std::packaged_task<Result()>(f));
+  std::future<Result> result = task->get_future();
+  {
+    std::unique_lock<std::mutex> lock(queueMutex);
+    tasks.push([task]() { (*task)(); });
+  }
+  condition.notify_one();
+  return result;
+}
+
+#endif
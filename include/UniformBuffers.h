@@ -0,0 +1,221 @@
+#ifndef UNIFORM_BUFFERS_H
+#define UNIFORM_BUFFERS_H
+
+#include <iostream>
+#include <cstring>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <GLDirectState.h>
+#include <GLExtensions.h>
+
+// 着色器里的std140 uniform块和固定的绑定点, 块的声明在shader/common/*_block.glsl里
+// C++结构体的成员顺序和填充必须和std140布局一致: vec3后面补一个float, 数组元素按16字节对齐
+enum UniformBlockBinding
+{
+  FRAME_BLOCK_BINDING = 0,  // 每帧一次: 时间
+  VIEW_BLOCK_BINDING = 1,   // 每个视图一次: 相机矩阵和位置
+  LIGHT_BLOCK_BINDING = 2,  // 每帧一次: 点光源
+  OBJECT_BLOCK_BINDING = 3, // 每次绘制: 模型矩阵
+  UNIFORM_BLOCK_BINDING_COUNT
+};
+
+struct FrameBlock
+{
+  glm::vec4 time; // x: 启动后的秒数, y: 帧间隔
+};
+
+struct ViewBlock
+{
+  glm::mat4 projection;
+  glm::mat4 view;
+  glm::mat4 projectionView;
+  glm::vec3 camPos;
+  float padding;
+};
+
+struct PointLightData
+{
+  glm::vec4 position; // w不用
+  glm::vec4 color;
+};
+
+// 着色器按NR_LIGHTS声明数组, 可以比MAX_LIGHTS短; 绑定的范围总是整个结构体
+const unsigned int MAX_LIGHTS = 32;
+
+struct LightBlock
+{
+  glm::ivec4 count; // x: 有效的光源个数
+  PointLightData lights[MAX_LIGHTS];
+};
+
+struct ObjectBlock
+{
+  glm::mat4 model;
+};
+
+// 块名 -> 绑定点, Shader链接后按名字设置; 不认识的块返回-1
+// advanced_glsl.vs里的Matrices块是View块的前两个成员, 直接共用View的数据
+inline int uniformBlockBinding(const char *name)
+{
+  if (strcmp(name, "Frame") == 0)
+    return FRAME_BLOCK_BINDING;
+  if (strcmp(name, "View") == 0 || strcmp(name, "Matrices") == 0)
+    return VIEW_BLOCK_BINDING;
+  if (strcmp(name, "Lights") == 0)
+    return LIGHT_BLOCK_BINDING;
+  if (strcmp(name, "Object") == 0)
+    return OBJECT_BLOCK_BINDING;
+  return -1;
+}
+
+// 每帧的统计
+struct UniformBufferStats
+{
+  size_t bytes;        // 写进环里的字节数
+  unsigned int binds;  // glBindBufferRange次数
+  unsigned int stalls; // 等待GPU用完环里区域的次数
+};
+
+// uniform块的数据环: 一个缓冲区分成3个区域, 每帧写一个区域, 帧末插入fence,
+// 三帧之后回到同一个区域时先等它的fence, 所以CPU写入不会覆盖GPU还在读的数据
+// 每次bind把数据追加到当前区域, 再用glBindBufferRange把这一段绑定到块的绑定点; 切换着色器不需要重新上传
+// 有GL 4.4/ARB_buffer_storage时整个缓冲区持久映射, 直接写; 否则每段用glBufferSubData上传
+class UniformBuffers
+{
+private:
+  static const unsigned int REGION_COUNT = 3;
+
+  unsigned int buffer;
+  unsigned char *mapped;
+  size_t regionSize;
+  size_t alignment;
+  unsigned int region;
+  size_t head;
+  GLsync fences[REGION_COUNT];
+  bool persistent;
+  UniformBufferStats current;
+  UniformBufferStats last;
+
+  UniformBuffers() : buffer(0), mapped(nullptr), regionSize(0), alignment(256), region(0), head(0), persistent(false)
+  {
+    for (unsigned int i = 0; i < REGION_COUNT; i++)
+      fences[i] = 0;
+    memset(&current, 0, sizeof(current));
+    memset(&last, 0, sizeof(last));
+  }
+  UniformBuffers(const UniformBuffers &) = delete;
+  UniformBuffers &operator=(const UniformBuffers &) = delete;
+
+  void waitFence(GLsync &fence);
+public:
+  static UniformBuffers &instance()
+  {
+    static UniformBuffers buffers;
+    return buffers;
+  }
+
+  // 在GL线程、loadGLExtensions之后调用, regionBytes是每帧可以写入的数据量
+  void init(size_t regionBytes = 1024 * 1024);
+  bool isEnabled() const { return buffer != 0; }
+
+  // 每帧开始时调用, 切换到下一个区域
+  void beginFrame();
+  // 把size字节写进环里并绑定到binding, 之后的绘制都读这一份, 直到下一次bind同一个绑定点
+  void bindRange(GLuint binding, const void *data, size_t size);
+  template <typename T>
+  void bind(GLuint binding, const T &block)
+  {
+    bindRange(binding, &block, sizeof(T));
+  }
+  // 每帧结束时调用, 给这一帧的区域插入fence
+  void endFrame();
+  const UniformBufferStats &lastFrame() const { return last; }
+};
+
+void UniformBuffers::init(size_t regionBytes)
+{
+  GLint offsetAlignment = 256;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+  alignment = offsetAlignment > 0 ? (size_t)offsetAlignment : 256;
+  regionSize = (regionBytes + alignment - 1) / alignment * alignment;
+  persistent = glCapabilities().bufferStorage;
+
+  buffer = createBufferObject();
+  size_t total = regionSize * REGION_COUNT;
+  if (persistent)
+  {
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    namedBufferStorage(buffer, total, nullptr, flags);
+    mapped = (unsigned char *)mapNamedBufferRange(buffer, 0, total, flags);
+    persistent = mapped != nullptr;
+  }
+  if (!persistent)
+    namedBufferData(buffer, total, nullptr, GL_STREAM_DRAW);
+  region = 0;
+  head = 0;
+}
+
+void UniformBuffers::waitFence(GLsync &fence)
+{
+  if (fence == 0)
+    return;
+  if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+  {
+    current.stalls++;
+    glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ULL);
+  }
+  glDeleteSync(fence);
+  fence = 0;
+}
+
+void UniformBuffers::beginFrame()
+{
+  if (buffer == 0)
+    return;
+  region = (region + 1) % REGION_COUNT;
+  head = 0;
+  waitFence(fences[region]);
+}
+
+void UniformBuffers::bindRange(GLuint binding, const void *data, size_t size)
+{
+  if (buffer == 0)
+    return;
+  size_t aligned = (size + alignment - 1) / alignment * alignment;
+  if (head + aligned > regionSize)
+  {
+    // 一帧写满了区域: 等GPU执行完目前提交的所有命令, 再从区域开头重新写
+    GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    waitFence(fence);
+    head = 0;
+    if (aligned > regionSize)
+    {
+      std::cout << "ERROR::UNIFORM_BUFFERS::block of " << size << " bytes is larger than the region" << std::endl;
+      return;
+    }
+  }
+  size_t offset = region * regionSize + head;
+  if (persistent)
+    memcpy(mapped + offset, data, size);
+  else
+    namedBufferSubData(buffer, offset, size, data);
+  glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, offset, size);
+  head += aligned;
+  current.bytes += size;
+  current.binds++;
+}
+
+void UniformBuffers::endFrame()
+{
+  if (buffer == 0)
+    return;
+  if (fences[region] != 0)
+    glDeleteSync(fences[region]);
+  fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  last = current;
+  memset(&current, 0, sizeof(current));
+}
+
+#endif
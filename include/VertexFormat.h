@@ -0,0 +1,138 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <cstddef>
+#include <stdint.h>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <GLExtensions.h>
+#include <GLState.h>
+
+// 顶点
+// 切线是MikkTSpace的约定: xyz是单位切线, w是手性(±1), 着色器里用B = cross(N, T.xyz) * (T.w < 0 ? -1 : 1)得到副切线
+// 只看w的符号: 压缩格式的w只有2位, 按GL 4.2之前的snorm规则-1会被还原成-1/3
+struct Vertex
+{
+  glm::vec3 Position;
+  glm::vec3 Normal;
+  glm::vec2 TexCoords;
+  glm::vec4 Tangent;
+};
+
+// 压缩的顶点格式, 20字节, 不到Vertex的一半:
+// 位置是网格包围盒内的16位定点数(第4个分量只是为了对齐), 着色器里用positionOffset + positionScale * aPos还原
+// 法线和切线是GL_INT_2_10_10_10_REV(切线的手性放在2位的w里), 纹理坐标是半精度浮点数, 这些GL会直接转换, 着色器不需要改
+struct PackedVertex
+{
+  uint16_t Position[4];
+  uint32_t Normal;
+  uint16_t TexCoords[2];
+  uint32_t Tangent;
+};
+
+enum VertexFormat
+{
+  VERTEX_FLOAT,  // Vertex, 48字节
+  VERTEX_PACKED  // PackedVertex, 20字节, 着色器需要positionOffset/positionScale
+};
+
+// 完整顶点和只有位置的顶点流每个顶点的字节数
+inline unsigned int vertexStride(VertexFormat format)
+{
+  return format == VERTEX_PACKED ? sizeof(PackedVertex) : sizeof(Vertex);
+}
+
+inline unsigned int positionStride(VertexFormat format)
+{
+  return format == VERTEX_PACKED ? 4 * sizeof(uint16_t) : sizeof(glm::vec3);
+}
+
+// 给当前绑定的VAO设置属性, 顶点缓冲要已经绑定到GL_ARRAY_BUFFER
+// positionOnly为true时只设置location 0, 对应只有位置的顶点流
+inline void setupVertexAttributes(VertexFormat format, bool positionOnly)
+{
+  glEnableVertexAttribArray(0);
+  if (positionOnly)
+  {
+    if (format == VERTEX_PACKED)
+      glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, positionStride(format), (void*)0);
+    else
+      glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, positionStride(format), (void*)0);
+    return;
+  }
+  glEnableVertexAttribArray(1);
+  glEnableVertexAttribArray(2);
+  glEnableVertexAttribArray(3);
+  if (format == VERTEX_PACKED)
+  {
+    glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)0);
+    glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Normal));
+    glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, TexCoords));
+    glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Tangent));
+  }
+  else
+  {
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+  }
+}
+
+// 直接访问的版本: 属性格式和顶点缓冲分开设置, 所有属性都从0号绑定点读
+inline void setupVertexArrayAttributes(unsigned int vao, VertexFormat format, bool positionOnly)
+{
+  glEnableVertexArrayAttrib(vao, 0);
+  glVertexArrayAttribBinding(vao, 0, 0);
+  if (positionOnly)
+  {
+    if (format == VERTEX_PACKED)
+      glVertexArrayAttribFormat(vao, 0, 3, GL_UNSIGNED_SHORT, GL_TRUE, 0);
+    else
+      glVertexArrayAttribFormat(vao, 0, 3, GL_FLOAT, GL_FALSE, 0);
+    return;
+  }
+  for (GLuint i = 1; i < 4; i++)
+  {
+    glEnableVertexArrayAttrib(vao, i);
+    glVertexArrayAttribBinding(vao, i, 0);
+  }
+  if (format == VERTEX_PACKED)
+  {
+    glVertexArrayAttribFormat(vao, 0, 3, GL_UNSIGNED_SHORT, GL_TRUE, 0);
+    glVertexArrayAttribFormat(vao, 1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(PackedVertex, Normal));
+    glVertexArrayAttribFormat(vao, 2, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(PackedVertex, TexCoords));
+    glVertexArrayAttribFormat(vao, 3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(PackedVertex, Tangent));
+  }
+  else
+  {
+    glVertexArrayAttribFormat(vao, 0, 3, GL_FLOAT, GL_FALSE, 0);
+    glVertexArrayAttribFormat(vao, 1, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, Normal));
+    glVertexArrayAttribFormat(vao, 2, 2, GL_FLOAT, GL_FALSE, offsetof(Vertex, TexCoords));
+    glVertexArrayAttribFormat(vao, 3, 4, GL_FLOAT, GL_FALSE, offsetof(Vertex, Tangent));
+  }
+}
+
+// 让vao从vertexBuffer读顶点、从indexBuffer读索引, 缓冲区换了以后再调用一次即可
+// 有直接访问时不绑定任何东西; 否则绑定vao设置完再解绑, 之后对GL_ELEMENT_ARRAY_BUFFER的绑定不会改到它
+inline void setupVertexArray(unsigned int vao, VertexFormat format, bool positionOnly, unsigned int vertexBuffer, unsigned int indexBuffer)
+{
+  unsigned int stride = positionOnly ? positionStride(format) : vertexStride(format);
+  if (glCapabilities().directStateAccess)
+  {
+    setupVertexArrayAttributes(vao, format, positionOnly);
+    glVertexArrayVertexBuffer(vao, 0, vertexBuffer, 0, stride);
+    glVertexArrayElementBuffer(vao, indexBuffer);
+    return;
+  }
+  GLState &state = GLState::instance();
+  state.bindVertexArray(vao);
+  glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+  setupVertexAttributes(format, positionOnly);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+  state.bindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+#endif
@@ -1,6 +1,15 @@
 #include <Camera.h>
 #include <Shader.h>
+#include <ShaderLibrary.h>
 #include <Model.h>
+#include <TextureCache.h>
+#include <StagingUploader.h>
+#include <UniformBuffers.h>
+#include <GLDirectState.h>
+#include <GLExtensions.h>
+#include <GLState.h>
+#include <GeometryArena.h>
+#include <Diagnostics.h>
 #include <FileSystem.h>
 
 #include <glad/glad.h>
@@ -29,6 +38,8 @@ void renderCube();
 // settings
 const unsigned int SCR_WIDTH = 1280;
 const unsigned int SCR_HEIGHT = 720;
+// 每帧最多上传的解码后贴图字节数, 超出的留到下一帧
+const size_t TEXTURE_UPLOAD_BUDGET = 8 * 1024 * 1024;
 
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
 float lastX = SCR_WIDTH / 2.0f, lastY = SCR_HEIGHT / 2.0f;
@@ -80,24 +91,20 @@ int main()
     std::cout << "Failed to initialize GLAD" << std::endl;
     return -1;
   }
+  loadGLExtensions((GLADloadproc)glfwGetProcAddress);
+  // 纹理和顶点数据经过PBO暂存环上传
+  StagingUploader::instance().init();
+  // 相机、光源和每次绘制的数据通过uniform块的环形缓冲区传给所有着色器
+  UniformBuffers::instance().init();
 
-  // 启用深度测试
-  glEnable(GL_DEPTH_TEST);
-  glDepthFunc(GL_LEQUAL);
-
-  // 创建着色器
-  Shader pbrShader("../shader/pbr.vs", "../shader/pbr.fs");
-  Shader equirectangularToCubemapShader("../shader/cubemap.vs", "../shader/cubemap.fs");
-  Shader irridianceShader("../shader/cubemap.vs", "../shader/irradiance_convolution.fs");
-  Shader backgroundShader("../shader/background.vs", "../shader/background.fs");
-
-  pbrShader.use();
-  pbrShader.setInt("irridianceMap", 0);
-  pbrShader.setVec3("albedo", glm::vec3(0.5f, 0.0f, 0.0f));
-  pbrShader.setFloat("ao", 1.0f);
+  // 贴图在线程池中解码, 主循环里按预算上传
+  TextureCache::instance().setAsyncDecode(true);
 
-  backgroundShader.use();
-  backgroundShader.setInt("environmentMap", 0);
+  // 绑定和开关状态都经过状态缓存, 和当前值相同的调用不会发给驱动
+  GLState &glState = GLState::instance();
+  // 启用深度测试
+  glState.enable(GL_DEPTH_TEST);
+  glState.depthFunc(GL_LEQUAL);
 
   // lights
   glm::vec3 lightPositions[] = {
@@ -112,33 +119,42 @@ int main()
     glm::vec3(300.0f, 300.0f, 300.0f),
     glm::vec3(300.0f, 300.0f, 300.0f),
   };
+  const size_t lightCount = sizeof(lightPositions) / sizeof(lightPositions[0]);
+
+  // 一次提交所有着色器, 驱动编译的同时加载HDR贴图和模型, 第一次get时才等待
+  // pbr按实际的灯光数量编译变体, 灯光循环可以完全展开; 不带定义时按MAX_LIGHTS个槽位循环
+  ShaderLibrary &shaders = ShaderLibrary::instance();
+  ShaderDefines pbrDefines;
+  pbrDefines.set("NR_LIGHTS", (int)lightCount);
+  shaders.declare("pbr", "../shader/pbr.vs", "../shader/pbr.fs");
+  shaders.request("pbr", pbrDefines);
+  shaders.add("equirectangularToCubemap", "../shader/cubemap.vs", "../shader/cubemap.fs");
+  shaders.add("irradiance", "../shader/cubemap.vs", "../shader/irradiance_convolution.fs");
+  shaders.add("background", "../shader/background.vs", "../shader/background.fs");
+
   int nrRows = 7;
   int nrColumns = 7;
   float spacing = 2.5;
 
-  unsigned int captureFBO, captureRBO;
-  glGenFramebuffers(1, &captureFBO);
-  glGenRenderbuffers(1, &captureRBO);
-
-  glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
-  glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
-  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 512, 512);
-  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, captureRBO);
+  // 有GL 4.5时帧缓冲和纹理都按名字直接创建和设置, 只有渲染到帧缓冲时才绑定
+  unsigned int captureFBO = createFramebufferObject();
+  unsigned int captureRBO = createRenderbufferObject();
+  renderbufferStorage(captureRBO, GL_DEPTH_COMPONENT24, 512, 512);
+  framebufferRenderbuffer(captureFBO, GL_DEPTH_ATTACHMENT, captureRBO);
 
-  stbi_set_flip_vertically_on_load(true);
+  TextureCache::instance().setFlipOnLoad(true);
   int width, height, nrComponents;
   float *data = stbi_loadf(FileSystem::getPath("resource/texture/hdr/newport_loft.hdr").c_str(), &width, &height, &nrComponents, 0);
   unsigned int hdrTexture;
   if (data)
   {
-    glGenTextures(1, &hdrTexture);
-    glBindTexture(GL_TEXTURE_2D, hdrTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, data); // note how we specify the texture's data value to be float
+    hdrTexture = createTextureObject(GL_TEXTURE_2D);
+    StagingUploader::instance().texImage2D(hdrTexture, 0, GL_RGB16F, width, height, GL_RGB, GL_FLOAT, data, (size_t)width * height * 3 * sizeof(float)); // note how we specify the texture's data value to be float
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    textureParameter(hdrTexture, GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    textureParameter(hdrTexture, GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    textureParameter(hdrTexture, GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    textureParameter(hdrTexture, GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
     stbi_image_free(data);
   }
@@ -147,18 +163,20 @@ int main()
     std::cout << "Failed to load HDR image." << std::endl;
   }
 
-  unsigned int envCubemap;
-  glGenTextures(1, &envCubemap);
-  glBindTexture(GL_TEXTURE_CUBE_MAP, envCubemap);
-  for (unsigned int i = 0; i < 6; ++i)
-  {
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, 512, 512, 0, GL_RGB, GL_FLOAT, nullptr);
-  }
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  // 球阵旁边的岩石, 按网格簇剔除后绘制
+  Model rock(FileSystem::getPath("resource/model/rock/rock.obj"), true);
+  glm::mat4 rockModel = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -8.0f));
+
+  // 资源加载的间隙收尾已经编译完的程序, 后面get时少等一些
+  shaders.poll();
+
+  unsigned int envCubemap = createTextureObject(GL_TEXTURE_CUBE_MAP);
+  textureStorage(envCubemap, GL_TEXTURE_CUBE_MAP, 1, GL_RGB16F, 512, 512, GL_RGB, GL_FLOAT);
+  textureParameter(envCubemap, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  textureParameter(envCubemap, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  textureParameter(envCubemap, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  textureParameter(envCubemap, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  textureParameter(envCubemap, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
   glm::mat4 captureProjection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 10.0f);
   glm::mat4 captureViews[] = 
@@ -171,68 +189,83 @@ int main()
     glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3( 0.0f,  0.0f, -1.0f), glm::vec3(0.0f, -1.0f,  0.0f))
   };
 
+  Shader &equirectangularToCubemapShader = shaders.get("equirectangularToCubemap");
   equirectangularToCubemapShader.use();
   equirectangularToCubemapShader.setInt("equirectangularMap", 0);
   equirectangularToCubemapShader.setMat4("projection", captureProjection);
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, hdrTexture);
+  glState.bindTextureUnit(0, GL_TEXTURE_2D, hdrTexture);
 
-  glViewport(0, 0, 512, 512);
-  glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
+  glState.viewport(0, 0, 512, 512);
+  glState.bindFramebuffer(GL_FRAMEBUFFER, captureFBO);
   for (unsigned int i = 0; i < 6; ++i)
   {
     equirectangularToCubemapShader.setMat4("view", captureViews[i]);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, envCubemap, 0);
+    framebufferTexture2D(captureFBO, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, envCubemap, 0);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     renderCube();
   }
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
 
-  unsigned int irradianceMap;
-  glGenTextures(1, &irradianceMap);
-  glBindTexture(GL_TEXTURE_CUBE_MAP, irradianceMap);
-  for (unsigned int i = 0; i < 6; ++i)
-  {
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, 32, 32, 0, GL_RGB, GL_FLOAT, nullptr);
-  }
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  unsigned int irradianceMap = createTextureObject(GL_TEXTURE_CUBE_MAP);
+  textureStorage(irradianceMap, GL_TEXTURE_CUBE_MAP, 1, GL_RGB16F, 32, 32, GL_RGB, GL_FLOAT);
+  textureParameter(irradianceMap, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  textureParameter(irradianceMap, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  textureParameter(irradianceMap, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  textureParameter(irradianceMap, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  textureParameter(irradianceMap, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-  glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
-  glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
-  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 32, 32);
+  renderbufferStorage(captureRBO, GL_DEPTH_COMPONENT24, 32, 32);
 
+  Shader &irridianceShader = shaders.get("irradiance");
   irridianceShader.use();
   irridianceShader.setInt("environmentMap", 0);
   irridianceShader.setMat4("projection", captureProjection);
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_CUBE_MAP, envCubemap);
+  glState.bindTextureUnit(0, GL_TEXTURE_CUBE_MAP, envCubemap);
 
-  glViewport(0, 0, 32, 32);
-  glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
+  glState.viewport(0, 0, 32, 32);
+  glState.bindFramebuffer(GL_FRAMEBUFFER, captureFBO);
   for (unsigned int i = 0; i < 6; ++i)
   {
     irridianceShader.setMat4("view", captureViews[i]);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, irradianceMap, 0);
+    framebufferTexture2D(captureFBO, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, irradianceMap, 0);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     renderCube();
   }
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
 
   glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+  Shader &pbrShader = shaders.get("pbr", pbrDefines);
   pbrShader.use();
-  pbrShader.setMat4("projection", projection);
+  pbrShader.setInt("irridianceMap", 0);
+  pbrShader.setVec3("albedo", glm::vec3(0.5f, 0.0f, 0.0f));
+  pbrShader.setFloat("ao", 1.0f);
+  Shader &backgroundShader = shaders.get("background");
   backgroundShader.use();
-  backgroundShader.setMat4("projection", projection);
+  backgroundShader.setInt("environmentMap", 0);
 
   int scrWidth, scrHeight;
   glfwGetFramebufferSize(window, &scrWidth, &scrHeight);
-  glViewport(0, 0, scrWidth, scrHeight);
+  glState.viewport(0, 0, scrWidth, scrHeight);
+
+  // 所有模型加载完之后, 共享几何体池的占用和碎片情况
+  GeometryArena::printReports();
+  // 所有程序都已经链接完成, 释放缓存里的着色器对象
+  shaders.finishAll();
+  ShaderStageCache::instance().printReport();
+  ShaderStageCache::instance().trim();
+
+  // 每帧都要设置的uniform在循环外解析成句柄, 循环里不再按名字查找
+  // 相机、光源和模型矩阵在uniform块里, 不属于某个着色器
+  Uniform<float> pbrMetallic = pbrShader.uniform<float>("metallic");
+  Uniform<float> pbrRoughness = pbrShader.uniform<float>("roughness");
+  UniformBuffers &uniformBuffers = UniformBuffers::instance();
+  StagingStats lastStagingStats = StagingStats();
+  UniformStats lastUniformStats = UniformStats();
+  UniformBufferStats lastBufferStats = UniformBufferStats();
+  GLStateStats lastStateStats = GLStateStats();
+  MeshletStats lastMeshletStats = MeshletStats();
 
   // 保持窗口打开, 接受用户输入, 不断绘制
   // ---------------------------------------------------------------------------
@@ -241,10 +274,14 @@ int main()
     float currentFrame = static_cast<float>(glfwGetTime());
     deltaTime = currentFrame - lastFrame;
     lastFrame = currentFrame;
+    uniformBuffers.beginFrame();
 
     // 接受键盘输入
     processInput(window);
 
+    // 上传这一帧之前解码完成的贴图
+    TextureCache::instance().processUploads(TEXTURE_UPLOAD_BUDGET);
+
     // 渲染指令
     // -------
     // 清空颜色缓冲并填充为深蓝绿色
@@ -252,22 +289,43 @@ int main()
     // 清除深度缓冲
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    pbrShader.use();
+    // 每帧和每个视图的数据只写一次, pbr和天空盒共用
+    FrameBlock frameBlock;
+    frameBlock.time = glm::vec4(currentFrame, deltaTime, 0.0f, 0.0f);
+    uniformBuffers.bind(FRAME_BLOCK_BINDING, frameBlock);
     glm::mat4 view = camera.GetViewMatrix();
-    pbrShader.setMat4("view", view);
-    pbrShader.setVec3("camPos", camera.Position);
+    ViewBlock viewBlock;
+    viewBlock.projection = projection;
+    viewBlock.view = view;
+    viewBlock.projectionView = projection * view;
+    viewBlock.camPos = camera.Position;
+    viewBlock.padding = 0.0f;
+    uniformBuffers.bind(VIEW_BLOCK_BINDING, viewBlock);
+    LightBlock lightBlock;
+    memset(&lightBlock, 0, sizeof(lightBlock));
+    lightBlock.count = glm::ivec4((int)lightCount, 0, 0, 0);
+    for (size_t i = 0; i < lightCount; ++i)
+    {
+      glm::vec3 newPos = lightPositions[i] + glm::vec3(sin(glfwGetTime() * 5.0) * 5.0, 0.0, 0.0);
+      newPos = lightPositions[i];
+      lightBlock.lights[i].position = glm::vec4(newPos, 1.0f);
+      lightBlock.lights[i].color = glm::vec4(lightColors[i], 0.0f);
+    }
+    uniformBuffers.bind(LIGHT_BLOCK_BINDING, lightBlock);
+    ObjectBlock objectBlock;
+
+    pbrShader.use();
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, irradianceMap);
+    glState.bindTextureUnit(0, GL_TEXTURE_CUBE_MAP, irradianceMap);
 
     glm::mat4 model = glm::mat4(1.0f);
     // render nrRows * nrColumns spheres
     for (int row = 0; row < nrRows; ++row)
     {
-      pbrShader.setFloat("metallic", (float)row / (float)nrRows);
+      pbrShader.set(pbrMetallic, (float)row / (float)nrRows);
       for (int col = 0; col < nrColumns; ++col)
       {
-        pbrShader.setFloat("roughness", glm::clamp((float)col / (float)nrColumns, 0.05f, 1.0f));
+        pbrShader.set(pbrRoughness, glm::clamp((float)col / (float)nrColumns, 0.05f, 1.0f));
 
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(
@@ -275,30 +333,32 @@ int main()
           (float)(row - (nrRows / 2)) * spacing,
           -2.0f
         ));
-        pbrShader.setMat4("model", model);
+        objectBlock.model = model;
+        uniformBuffers.bind(OBJECT_BLOCK_BINDING, objectBlock);
         renderSphere();
       }
     }
 
     // render light
-    for (size_t i = 0; i < sizeof(lightPositions) / sizeof(lightPositions[0]); ++i)
+    for (size_t i = 0; i < lightCount; ++i)
     {
-      glm::vec3 newPos = lightPositions[i] + glm::vec3(sin(glfwGetTime() * 5.0) * 5.0, 0.0, 0.0);
-      newPos = lightPositions[i];
-      pbrShader.setVec3("lightPositions[" + std::to_string(i) + "]", newPos);
-      pbrShader.setVec3("lightColors[" + std::to_string(i) + "]", lightColors[i]);
-
       model = glm::mat4(1.0f);
-      model = glm::translate(model, newPos);
+      model = glm::translate(model, glm::vec3(lightBlock.lights[i].position));
       model = glm::scale(model, glm::vec3(0.5f));
-      pbrShader.setMat4("model", model);
+      objectBlock.model = model;
+      uniformBuffers.bind(OBJECT_BLOCK_BINDING, objectBlock);
       renderSphere();
     }
 
+    pbrShader.set(pbrMetallic, 0.0f);
+    pbrShader.set(pbrRoughness, 0.8f);
+    objectBlock.model = rockModel;
+    uniformBuffers.bind(OBJECT_BLOCK_BINDING, objectBlock);
+    rock.DrawCulled(pbrShader, viewBlock.projectionView, rockModel, camera.Position);
+
+    // 天空盒直接用已经绑定的View块, 不需要再传相机矩阵
     backgroundShader.use();
-    backgroundShader.setMat4("view", view);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, envCubemap);
+    glState.bindTextureUnit(0, GL_TEXTURE_CUBE_MAP, envCubemap);
     renderCube();
 
     // equirectangularToCubemapShader.use();
@@ -307,12 +367,44 @@ int main()
     // glBindTexture(GL_TEXTURE_2D, hdrTexture);
     // renderCube();
 
+    // 回收暂存块, 上传量变化或者有等待时打印带宽和等待次数
+    StagingUploader::instance().endFrame();
+    const StagingStats &staging = StagingUploader::instance().lastFrame();
+    if (staging.uploads != lastStagingStats.uploads || staging.bytes != lastStagingStats.bytes || staging.stalls > 0)
+      std::cout << "STAGING:: " << staging.uploads << " uploads, " << staging.bytes / 1024 << " KB, "
+                << staging.stalls << " stalls, " << staging.deferred << " deferred" << std::endl;
+    lastStagingStats = staging;
+    // 第一帧(链接时的查询)、有名字查不到或者上传次数变化时打印
+    UniformStats uniformStats = UniformStats::endFrame();
+    uniformStats.print(lastUniformStats);
+    lastUniformStats = uniformStats;
+    // 给这一帧写过的uniform块区域插入fence, 数据量或者等待次数变化时打印
+    uniformBuffers.endFrame();
+    const UniformBufferStats &bufferStats = uniformBuffers.lastFrame();
+    if (bufferStats.binds != lastBufferStats.binds || bufferStats.bytes != lastBufferStats.bytes || bufferStats.stalls > 0)
+      std::cout << "UBO:: " << bufferStats.binds << " binds, " << bufferStats.bytes / 1024 << " KB, "
+                << bufferStats.stalls << " stalls" << std::endl;
+    lastBufferStats = bufferStats;
+    // 发出和过滤掉的状态调用数变化时打印
+    glState.endFrame();
+    const GLStateStats &stateStats = glState.lastFrame();
+    if (stateStats.issued != lastStateStats.issued || stateStats.filtered != lastStateStats.filtered)
+      std::cout << "GLSTATE:: " << stateStats.issued << " issued, " << stateStats.filtered << " filtered" << std::endl;
+    lastStateStats = stateStats;
+    // 打开verboseCulling时, 剔除结果变化(相机移动)时打印提交的三角形比例; 统计每帧都要清零
+    MeshletStats meshletStats = MeshletStats::endFrame();
+    if (Diagnostics::verboseCulling && (meshletStats.submitted != lastMeshletStats.submitted || meshletStats.draws != lastMeshletStats.draws))
+      meshletStats.print();
+    lastMeshletStats = meshletStats;
+
     // 将缓冲区的像素颜色值绘制到窗口
     glfwSwapBuffers(window);
     // 检查有没有触发事件
     glfwPollEvents();
   }
-  // 释放资源
+  // 释放资源, GL对象要在上下文销毁之前删除
+  rock.release();
+  shaders.clear();
   glfwTerminate();
   return 0;
 }
@@ -322,7 +414,7 @@ void framebuffer_size_callback(GLFWwindow *window, int width, int height)
 {
   // 渲染窗口的大小, glViewport函数前两个参数控制窗口左下角的位置。第三个和第四个参数控制渲染窗口的宽度和高度（像素）
   // 图形学里的viewport视口
-  glViewport(0, 0, width, height);
+  GLState::instance().viewport(0, 0, width, height);
 }
 
 // 接受键盘输入
@@ -365,88 +457,15 @@ void scroll_callback(GLFWwindow *window, double xoffset, double yoffset)
   camera.ProcessMouseScroll(yoffset);
 }
 
+// 贴图都交给全局TextureCache, 内容相同的图片只会解码上传一次
 unsigned int loadTexture(char const *path, bool gammaCorrection)
 {
-  unsigned int textureID;
-  glGenTextures(1, &textureID);
-
-  int width, height, nrComponents;
-  unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-  if (data)
-  {
-    GLenum internalFormat;
-    GLenum dataFormat;
-    if (nrComponents == 1)
-    {
-      internalFormat = dataFormat = GL_RED;
-    }
-    else if (nrComponents == 3)
-    {
-      internalFormat = gammaCorrection ? GL_SRGB : GL_RGB;
-      dataFormat = GL_RGB;
-    }
-    else if (nrComponents == 4)
-    {
-      internalFormat = gammaCorrection ? GL_SRGB_ALPHA : GL_RGBA;
-      dataFormat = GL_RGBA;  // 4通道, 包含alpha通道(透明度)
-    }
-
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, dataFormat, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, dataFormat == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT); // 如果是四通道, 则需要将纹理的环绕方式改为GL_CLAMP_TO_EDGE, 这样草的纹理才不会出现白边
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, dataFormat == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    stbi_image_free(data);
-  }
-  else
-  {
-    std::cout << "Texture failed to load at path: " << path << std::endl;
-    stbi_image_free(data);
-  }
-  return textureID; 
+  return TextureCache::instance().acquire(path, TextureOptions(gammaCorrection, true));
 }
 
 unsigned int loadCubemap(std::vector<std::string> faces)
 {
-  unsigned int textureID;
-  glGenTextures(1, &textureID);
-  glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-
-  int width, height, nrChannels;
-  for (unsigned int i = 0; i < faces.size(); i++)
-  {
-    unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-    if (data)
-    {
-      GLenum format;
-      if (nrChannels == 1)
-        format = GL_RED;
-      else if (nrChannels == 3)
-        format = GL_RGB;
-      else if (nrChannels == 4)
-        format = GL_RGBA;  // 4通道, 包含alpha通道(透明度)
-
-      glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-      glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
-      stbi_image_free(data);
-    }
-    else
-    {
-      std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-      stbi_image_free(data);
-    }
-  }
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-  return textureID; 
+  return TextureCache::instance().acquireCubemap(faces);
 }
 
 unsigned int sphereVAO = 0;
@@ -526,7 +545,7 @@ void renderSphere()
         data.push_back(uv[i].y);
       }
     }
-    glBindVertexArray(sphereVAO);
+    GLState::instance().bindVertexArray(sphereVAO);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
     glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), &data[0], GL_STATIC_DRAW);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
@@ -539,7 +558,7 @@ void renderSphere()
     glEnableVertexAttribArray(2);
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
   }
-  glBindVertexArray(sphereVAO);
+  GLState::instance().bindVertexArray(sphereVAO);
   glDrawElements(GL_TRIANGLE_STRIP, indexCount, GL_UNSIGNED_INT, 0);
 }
 
@@ -599,7 +618,7 @@ void renderCube()
     glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
     // link vertex attributes
-    glBindVertexArray(cubeVAO);
+    GLState::instance().bindVertexArray(cubeVAO);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(1);
@@ -607,11 +626,9 @@ void renderCube()
     glEnableVertexAttribArray(2);
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
     glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
   }
-  glBindVertexArray(cubeVAO);
+  GLState::instance().bindVertexArray(cubeVAO);
   glDrawArrays(GL_TRIANGLES, 0, 36);
-  glBindVertexArray(0);
 }
 
 // void framebuffer_size_callback(GLFWwindow* window, int width, int height);
@@ -0,0 +1,2 @@
+// shared constants, pulled in with #include "common/constants.glsl"
+const float PI = 3.14159265359;
@@ -0,0 +1,5 @@
+// per-frame data, bound to FRAME_BLOCK_BINDING by UniformBuffers (layout must match FrameBlock)
+layout (std140) uniform Frame
+{
+  vec4 time; // x: seconds since start, y: frame delta
+};
@@ -0,0 +1,21 @@
+// point lights, bound to LIGHT_BLOCK_BINDING by UniformBuffers (layout must match LightBlock)
+// NR_LIGHTS may be smaller than MAX_LIGHTS on the C++ side, element offsets do not depend on it
+// without a define every slot is declared, unused lights are zeroed on the C++ side
+#ifndef NR_LIGHTS
+#define NR_LIGHTS 32
+#endif
+#if NR_LIGHTS > 32
+#error NR_LIGHTS is larger than MAX_LIGHTS, the block would read past the bound range
+#endif
+
+struct PointLight
+{
+  vec4 position;
+  vec4 color;
+};
+
+layout (std140) uniform Lights
+{
+  ivec4 lightCount;
+  PointLight lights[NR_LIGHTS];
+};
@@ -0,0 +1,7 @@
+// tangent-space normal from a normal map
+// normal maps are cooked to BC5 which only keeps XY, rebuild Z from the unit length
+vec3 sampleNormalMap(sampler2D map, vec2 uv)
+{
+  vec2 normalXY = texture(map, uv).rg * 2.0 - 1.0;
+  return vec3(normalXY, sqrt(max(1.0 - dot(normalXY, normalXY), 0.0)));
+}
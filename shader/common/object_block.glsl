@@ -0,0 +1,5 @@
+// per-draw data, bound to OBJECT_BLOCK_BINDING by UniformBuffers (layout must match ObjectBlock)
+layout (std140) uniform Object
+{
+  mat4 model;
+};
@@ -0,0 +1,9 @@
+// Mesh with VERTEX_PACKED stores positions as 16-bit values inside its bounding box,
+// the defaults leave float positions untouched
+uniform vec3 positionOffset = vec3(0.0);
+uniform vec3 positionScale = vec3(1.0);
+
+vec3 unpackPosition(vec3 position)
+{
+  return positionOffset + positionScale * position;
+}
@@ -0,0 +1,8 @@
+// camera data, bound to VIEW_BLOCK_BINDING by UniformBuffers (layout must match ViewBlock)
+layout (std140) uniform View
+{
+  mat4 projection;
+  mat4 view;
+  mat4 projectionView;
+  vec3 camPos;
+};
@@ -4,7 +4,7 @@ in vec3 WorldPos;
 
 uniform samplerCube environmentMap;
 
-const float PI = 3.14159265359;
+#include "common/constants.glsl"
 
 void main()
 {
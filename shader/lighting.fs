@@ -12,7 +12,10 @@ struct Light {
   vec3 Color;
 };
 
-uniform Light lights[16];
+#ifndef NR_LIGHTS
+#define NR_LIGHTS 16
+#endif
+uniform Light lights[NR_LIGHTS];
 uniform sampler2D diffuseTexture;
 uniform vec3 viewPos;
 
@@ -24,7 +27,7 @@ void main()
   vec3 ambient = 0.0 * color;
 
   vec3 lighting = vec3(0.0);
-  for (int i = 0; i < 16; ++i)
+  for (int i = 0; i < NR_LIGHTS; ++i)
   {
     vec3 lightDir = normalize(lights[i].Position - fs_in.FragPos);
     float diff = max(dot(normal, lightDir), 0.0);
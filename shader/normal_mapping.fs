@@ -15,12 +15,11 @@ uniform sampler2D normalMap;
 uniform vec3 lightPos;
 uniform vec3 viewPos;
 
+#include "common/normal_map.glsl"
+
 void main()
 {
-  // obrain normal from normal map in range [0, 1]
-  vec3 normal = texture(normalMap, fs_in.TexCoords).rgb;
-  // transform normal vector to range [-1, 1]
-  normal = normalize(normal * 2.0 - 1.0);
+  vec3 normal = sampleNormalMap(normalMap, fs_in.TexCoords);
 
   // get diffuse color
   vec3 color = texture(diffuseMap, fs_in.TexCoords).rgb;
@@ -15,6 +15,8 @@ uniform sampler2D depthMap;
 
 uniform float heightScale;
 
+#include "common/normal_map.glsl"
+
 vec2 ParallaxMapping(vec2 texCoords, vec3 viewDir)
 {
   float height = texture(depthMap, texCoords).r;
@@ -30,8 +32,7 @@ void main()
   if (texCoords.x > 1.0 || texCoords.y > 1.0 || texCoords.x < 0.0 || texCoords.y < 0.0)
     discard;
 
-  vec3 normal = texture(normalMap, texCoords).rgb;
-  normal = normalize(normal * 2.0 - 1.0);
+  vec3 normal = sampleNormalMap(normalMap, texCoords);
 
 
   vec3 color = texture(diffuseMap, texCoords).rgb;
@@ -2,8 +2,7 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
-layout (location = 3) in vec3 aTangent;
-layout (location = 4) in vec3 aBitangent;
+layout (location = 3) in vec4 aTangent;
 
 out VS_OUT {
   vec3 FragPos;
@@ -25,9 +24,9 @@ void main()
   vs_out.FragPos = vec3(model * vec4(aPos, 1.0));
   vs_out.TexCoords = aTexCoords;
 
-  vec3 T = normalize(mat3(model) * aTangent);
-  vec3 B = normalize(mat3(model) * aBitangent);
+  vec3 T = normalize(mat3(model) * aTangent.xyz);
   vec3 N = normalize(mat3(model) * aNormal);
+  vec3 B = cross(N, T) * (aTangent.w < 0.0 ? -1.0 : 1.0);
   mat3 TBN = transpose(mat3(T, B, N));
 
   vs_out.TangentLightPos = TBN * lightPos;
@@ -3,9 +3,11 @@ out vec4 FragColor;
 in vec2 TexCoords;
 in vec3 WorldPos;
 in vec3 Normal;
+// in vec4 Tangent;
 
 // uniform sampler2D albedoMap;
 // uniform sampler2D normalMap;
+// #include "common/normal_map.glsl"
 // uniform sampler2D metallicMap;
 // uniform sampler2D roughnessMap;
 // uniform sampler2D aoMap;
@@ -17,72 +19,23 @@ uniform float ao;
 
 uniform samplerCube irridianceMap;
 
-uniform vec3 lightPositions[4];
-uniform vec3 lightColors[4];
-
-uniform vec3 camPos;
-
-const float PI = 3.14159265359;
+#include "common/view_block.glsl"
+#include "common/light_block.glsl"
 
 // vec3 getNormalFromMap()
 // {
-//   vec3 tangentNormal = texture(normalMap, TexCoords).xyz * 2.0 - 1.0;
-
-//   vec3 Q1 = dFdx(WorldPos);
-//   vec3 Q2 = dFdy(WorldPos);
-//   vec2 st1 = dFdx(TexCoords);
-//   vec2 st2 = dFdy(TexCoords);
+//   vec3 tangentNormal = sampleNormalMap(normalMap, TexCoords);
 
+//   // tangents are generated at import, so the TBN comes from the vertex shader instead of dFdx/dFdy
 //   vec3 N = normalize(Normal);
-//   vec3 T = normalize(Q1 * st2.t - Q2 * st1.t);
-//   vec3 B = -normalize(cross(N, T));
+//   vec3 T = normalize(Tangent.xyz - dot(Tangent.xyz, N) * N);
+//   vec3 B = cross(N, T) * Tangent.w;
 //   mat3 TBN = mat3(T, B, N);
 
 //   return normalize(TBN * tangentNormal);
 // }
 
-// normal distribution function
-float DistributionGGX(vec3 N, vec3 H, float roughness)
-{
-    float a = roughness*roughness;
-    float a2 = a*a;
-    float NdotH = max(dot(N, H), 0.0);
-    float NdotH2 = NdotH*NdotH;
-
-    float nom   = a2;
-    float denom = (NdotH2 * (a2 - 1.0) + 1.0);
-    denom = PI * denom * denom;
-
-    return nom / denom;
-}
-
-// mask function.
-float GeometrySchlickGGX(float NdotV, float roughness)
-{
-    float r = (roughness + 1.0);
-    float k = (r*r) / 8.0;
-
-    float nom   = NdotV;
-    float denom = NdotV * (1.0 - k) + k;
-
-    return nom / denom;
-}
-
-float GeometrySmith(vec3 N, vec3 V, vec3 L, float roughness)
-{
-    float NdotV = max(dot(N, V), 0.0);
-    float NdotL = max(dot(N, L), 0.0);
-    float ggx2 = GeometrySchlickGGX(NdotV, roughness);
-    float ggx1 = GeometrySchlickGGX(NdotL, roughness);
-
-    return ggx1 * ggx2;
-}
-
-// fresnel function. 反射率
-vec3 fresnelSchlick(float cosTheta, vec3 F0)
-{
-    return F0 + (1.0 - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
-}
+#include "common/brdf.glsl"
 
 void main()
 {
@@ -102,13 +55,13 @@ void main()
   F0 = mix(F0, albedo, metallic);
 
   vec3 Lo = vec3(0.0);
-  for (int i = 0; i < 4; ++i)
+  for (int i = 0; i < NR_LIGHTS; ++i)
   {
-    vec3 L = normalize(lightPositions[i] - WorldPos);
+    vec3 L = normalize(lights[i].position.xyz - WorldPos);
     vec3 H = normalize(V + L);
-    float distance = length(lightPositions[i] - WorldPos);
+    float distance = length(lights[i].position.xyz - WorldPos);
     float attenuation = 1.0 / (distance * distance);
-    vec3 radiance = lightColors[i] * attenuation;
+    vec3 radiance = lights[i].color.rgb * attenuation;
 
     float NDF = DistributionGGX(N, H, roughness);
     float G = GeometrySmith(N, V, L, roughness);
@@ -2,20 +2,22 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+// layout (location = 3) in vec4 aTangent;
 
 out vec2 TexCoords;
 out vec3 WorldPos;
 out vec3 Normal;
+// out vec4 Tangent;
 
-uniform mat4 projection;
-uniform mat4 view;
-uniform mat4 model;
+#include "common/view_block.glsl"
+#include "common/object_block.glsl"
 
 void main()
 {
   TexCoords = aTexCoords;
   WorldPos = vec3(model * vec4(aPos, 1.0));
   Normal = mat3(model) * aNormal;
+  // Tangent = vec4(mat3(model) * aTangent.xyz, aTangent.w);
 
-  gl_Position = projection * view * vec4(WorldPos, 1.0);
+  gl_Position = projectionView * vec4(WorldPos, 1.0);
 }
\ No newline at end of file
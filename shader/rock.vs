@@ -6,6 +6,8 @@ layout (location = 3) in mat4 instanceMatrix;
 
 out vec2 TexCoords;
 
+#include "common/packed_position.glsl"
+
 uniform mat4 projection;
 uniform mat4 view;
 
@@ -15,5 +17,5 @@ void main()
   // gl_Position = vec4(pos + aOffset, 0.0, 1.0);
   // fColor = aColor;
   TexCoords = aTexCoord;
-  gl_Position = projection * view * instanceMatrix * vec4(aPos, 1.0);
+  gl_Position = projection * view * instanceMatrix * vec4(unpackPosition(aPos), 1.0);
 }
\ No newline at end of file
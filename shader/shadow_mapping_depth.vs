@@ -1,10 +1,12 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 
+#include "common/packed_position.glsl"
+
 uniform mat4 lightSpaceMatrix;
 uniform mat4 model;
 
 void main()
 {
-  gl_Position = lightSpaceMatrix * model * vec4(aPos, 1.0);
+  gl_Position = lightSpaceMatrix * model * vec4(unpackPosition(aPos), 1.0);
 }
\ No newline at end of file
@@ -7,9 +7,12 @@ uniform sampler2D gPosition;
 uniform sampler2D gNormal;
 uniform sampler2D texNoise;
 
-uniform vec3 samples[64];
+#ifndef KERNEL_SIZE
+#define KERNEL_SIZE 64
+#endif
+uniform vec3 samples[KERNEL_SIZE];
 
-int kernelSize = 64;
+const int kernelSize = KERNEL_SIZE;
 float radius = 0.5;
 float bias = 0.025;
 